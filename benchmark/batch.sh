@@ -0,0 +1,85 @@
+#!/bin/sh
+#
+# Copyright (c) 2017 Martin Decky
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# - Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# - The name of the author may not be used to endorse or promote products
+#   derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+# NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+# THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+#
+# Measure the scaling of the batch mode of the interpreter. The same
+# program is executed on a batch of inputs using an increasing number
+# of worker threads (powers of two up to the number of processors).
+#
+# Usage: batch.sh [<interpreter> [<program> [<inputs>]]]
+#
+# The default workload executes the Mandelbrot example (which does
+# not depend on the input) using the JIT engine on four inputs per
+# processor. The maximal number of threads can be overridden by the
+# PROCESSORS environment variable and the engine by the ENGINE
+# environment variable (e.g. ENGINE=--engine=lockstep).
+#
+
+INTERPRETER="${1:-./brainfuck}"
+PROGRAM="${2:-examples/mandelbrot.bf}"
+PROCESSORS="${PROCESSORS:-$(getconf _NPROCESSORS_ONLN)}"
+INPUTS="${3:-$((PROCESSORS * 4))}"
+ENGINE="${ENGINE:---jit}"
+
+BATCH="$(mktemp)"
+trap 'rm -f "$BATCH"' EXIT
+seq 1 "$INPUTS" > "$BATCH"
+
+now() {
+	date +%s%N
+}
+
+echo "threads,seconds,speedup,efficiency"
+
+THREADS=1
+BASE=""
+
+while true ; do
+	START="$(now)"
+	"$INTERPRETER" $ENGINE --batch="$BATCH" --threads="$THREADS" "$PROGRAM" > /dev/null || exit 1
+	END="$(now)"
+	
+	if [ -z "$BASE" ] ; then
+		BASE="$((END - START))"
+	fi
+	
+	awk -v threads="$THREADS" -v base="$BASE" -v time="$((END - START))" 'BEGIN {
+		printf("%d,%.3f,%.2f,%.2f\n", threads, time / 1e9, base / time,
+		    base / time / threads)
+	}'
+	
+	if [ "$THREADS" -ge "$PROCESSORS" ] ; then
+		break
+	fi
+	
+	THREADS="$((THREADS * 2))"
+	if [ "$THREADS" -gt "$PROCESSORS" ] ; then
+		THREADS="$PROCESSORS"
+	fi
+done
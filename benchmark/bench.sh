@@ -0,0 +1,221 @@
+#!/bin/sh
+#
+# Copyright (c) 2017 Martin Decky
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# - Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# - The name of the author may not be used to endorse or promote products
+#   derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+# NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+# THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+#
+# Run the sample programs listed in examples/list.csv (both their
+# Brainfuck and Ichiglyph forms) using each execution engine, verify
+# their output and report the wall-clock time, the number of the
+# input and output system calls and the peak resident set size (as
+# reported by the --stats option of the interpreters). The number of
+# the dispatched compiled instructions comes from a second execution
+# with the execution counters (as reported by the --counters option
+# of the interpreters), thus the counting does not affect the time.
+#
+# The input of each program is benchmark/corpus/<name>.in (empty if
+# missing) and its expected output is benchmark/corpus/<name>.out.
+# The programs that do not terminate (e.g. the Fibonacci example)
+# are stopped at a deterministic point by the budget in benchmark/
+# corpus/<name>.budget. The other programs run without a budget
+# (unless the BUDGET environment variable is set), thus the timing
+# does not include charging the budget.
+#
+# The lockstep engine executes a batch of as many copies of the
+# input as there are lanes (its time and system calls cover all of
+# them and the number of the inputs is reported). The batches cannot
+# be counted, thus its number of the instructions is missing. If the
+# program cannot be executed in lockstep (the interpreter would fall
+# back to the direct-threaded engine), it is not measured and the
+# status is "fallback".
+#
+# Usage: bench.sh [<csv> [<json>]]
+#
+# The results are printed as CSV and written to the CSV and JSON
+# files (bench.csv and bench.json by default). The engines can be
+# overridden by the ENGINES environment variable. The script fails
+# if the output of any execution does not match.
+#
+
+CSV="${1:-bench.csv}"
+JSON="${2:-bench.json}"
+ENGINES="${ENGINES:-switch threaded jit tiered lockstep}"
+BUDGET="${BUDGET:-}"
+CORPUS="benchmark/corpus"
+LANES=16
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+mkdir "$WORK/batch" "$WORK/empty"
+
+echo "program,language,engine,status,inputs,seconds,instructions,syscalls,rss_kib" | tee "$CSV"
+
+FAILED=0
+
+while read -r NAME ; do
+	if [ -z "$NAME" ] ; then
+		continue
+	fi
+	
+	INPUT="$CORPUS/$NAME.in"
+	if [ ! -f "$INPUT" ] ; then
+		INPUT="/dev/null"
+	fi
+	
+	LIMIT="$BUDGET"
+	if [ -f "$CORPUS/$NAME.budget" ] ; then
+		LIMIT="$(cat "$CORPUS/$NAME.budget")"
+	fi
+	
+	for LANGUAGE in bf ig ; do
+		if [ "$LANGUAGE" = "bf" ] ; then
+			INTERPRETER="./brainfuck"
+		else
+			INTERPRETER="./ichiglyph"
+		fi
+		
+		for ENGINE in $ENGINES ; do
+			#
+			# The lockstep engine executes only batches, thus
+			# the input is supplied as a batch that fills all
+			# lanes. Whether the program can be executed in
+			# lockstep is probed by an empty batch first.
+			#
+			if [ "$ENGINE" = "lockstep" ] ; then
+				"$INTERPRETER" --engine="$ENGINE" --batch="$WORK/empty" \
+				    "examples/$NAME.$LANGUAGE" 2> "$WORK/stats"
+				
+				if grep -q "Cannot execute in lockstep" "$WORK/stats" ; then
+					echo "$NAME,$LANGUAGE,$ENGINE,fallback,,,,," | tee -a "$CSV"
+					continue
+				fi
+				
+				INPUTS="$LANES"
+				: > "$WORK/expected"
+				for LANE in $(seq 1 "$LANES") ; do
+					cp "$INPUT" "$WORK/batch/$(printf "%02d" "$LANE")"
+					cat "$CORPUS/$NAME.out" >> "$WORK/expected"
+				done
+				
+				"$INTERPRETER" --engine="$ENGINE" --stats \
+				    ${LIMIT:+--budget="$LIMIT"} --batch="$WORK/batch" \
+				    --threads=1 "examples/$NAME.$LANGUAGE" > "$WORK/output" \
+				    2> "$WORK/stats"
+			else
+				INPUTS=1
+				cp "$CORPUS/$NAME.out" "$WORK/expected"
+				
+				"$INTERPRETER" --engine="$ENGINE" --stats \
+				    ${LIMIT:+--budget="$LIMIT"} "examples/$NAME.$LANGUAGE" \
+				    < "$INPUT" > "$WORK/output" 2> "$WORK/stats"
+			fi
+			
+			RET="$?"
+			
+			#
+			# Exhausting the budget is expected for the programs
+			# that do not terminate.
+			#
+			STATUS="ok"
+			if [ "$RET" -ne 0 ] && [ "$RET" -ne 7 ] ; then
+				STATUS="error"
+			elif ! cmp -s "$WORK/output" "$WORK/expected" ; then
+				STATUS="mismatch"
+			fi
+			
+			if [ "$STATUS" != "ok" ] ; then
+				FAILED=1
+			fi
+			
+			#
+			# The instructions are counted by a separate execution
+			# with the same options.
+			#
+			: > "$WORK/counters"
+			if [ "$ENGINE" != "lockstep" ] ; then
+				"$INTERPRETER" --engine="$ENGINE" --counters \
+				    ${LIMIT:+--budget="$LIMIT"} "examples/$NAME.$LANGUAGE" \
+				    < "$INPUT" > /dev/null 2> "$WORK/counters"
+				
+				RET="$?"
+				if [ "$RET" -ne 0 ] && [ "$RET" -ne 7 ] ; then
+					: > "$WORK/counters"
+				fi
+			fi
+			
+			#
+			# The statistics and the counters are the last lines
+			# of the standard error outputs (the values are missing
+			# if the interpreter failed).
+			#
+			awk -v stats="$(tail -n 1 "$WORK/stats")" \
+			    -v counters="$(tail -n 1 "$WORK/counters")" -v name="$NAME" \
+			    -v language="$LANGUAGE" -v engine="$ENGINE" -v status="$STATUS" \
+			    -v inputs="$INPUTS" 'BEGIN {
+				if (split(stats, field, ", ") != 4)
+					split(", , , ", field, ", ")
+				
+				count = split(field[1], time, " ")
+				split(field[3], syscalls, " ")
+				split(field[4], rss, " ")
+				
+				if (split(counters, field, ", ") != 4)
+					split(", , , ", field, ", ")
+				
+				split(field[1], instructions, " ")
+				
+				printf("%s,%s,%s,%s,%s,%s,%s,%s,%s\n", name, language, engine,
+				    status, inputs, time[count - 1], instructions[2],
+				    syscalls[1], rss[1])
+			}' | tee -a "$CSV"
+		done
+	done
+done < examples/list.csv
+
+awk -F ',' 'NR == 1 {
+	for (i = 1; i <= NF; i++)
+		key[i] = $i
+	
+	printf("[")
+	next
+}
+{
+	printf("%s\n  {", (NR > 2) ? "," : "")
+	for (i = 1; i <= NF; i++) {
+		if (i <= 4)
+			printf("\"%s\": \"%s\"", key[i], $i)
+		else
+			printf("\"%s\": %s", key[i], ($i != "") ? $i : "null")
+		
+		printf("%s", (i < NF) ? ", " : "}")
+	}
+}
+END {
+	printf("\n]\n")
+}' "$CSV" > "$JSON"
+
+exit "$FAILED"
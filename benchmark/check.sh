@@ -0,0 +1,191 @@
+#!/bin/sh
+#
+# Copyright (c) 2017 Martin Decky
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# - Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# - The name of the author may not be used to endorse or promote products
+#   derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+# NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+# THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+#
+#
+# Run the sample programs listed in examples/list.csv (both their
+# Brainfuck and Ichiglyph forms) using each execution engine with
+# the execution counters (as reported by the --counters option of
+# the interpreters) and compare the counters with the baseline.
+# Unlike the wall-clock time, the counters (the dispatched compiled
+# instructions, the span of the addressed tape cells, i.e. the
+# distance from the lowest to the highest addressed cell plus one,
+# and the calls of the input and output callbacks) are deterministic,
+# thus any change of the compiler that makes them grow is detected
+# reliably.
+#
+# The beginning of the programs that does not depend on the input
+# is not evaluated in advance (--no-fold), otherwise most of the
+# sample programs would fold into a few instructions that leave
+# nothing to compare.
+#
+# The inputs, expected outputs and budgets come from
+# benchmark/corpus (see bench.sh).
+#
+# Usage: check.sh [<baseline>]
+#
+# The engines can be selected by the ENGINES environment variable
+# (all engines counting the instructions by default).
+#
+# The baseline is benchmark/baseline.csv by default. The script
+# fails if the output of any execution does not match, if any
+# counter exceeds the baseline or if the baseline is missing.
+# If the UPDATE environment variable is set to 1, the baseline
+# is rewritten with the current counters instead.
+#
+
+BASELINE="${1:-benchmark/baseline.csv}"
+BUDGET="${BUDGET:-100000000000}"
+ENGINES="${ENGINES:-switch threaded jit tiered}"
+CORPUS="benchmark/corpus"
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+echo "program,language,engine,instructions,span,input,output" > "$WORK/current"
+
+FAILED=0
+
+while read -r NAME ; do
+	if [ -z "$NAME" ] ; then
+		continue
+	fi
+
+	INPUT="$CORPUS/$NAME.in"
+	if [ ! -f "$INPUT" ] ; then
+		INPUT="/dev/null"
+	fi
+
+	LIMIT="$BUDGET"
+	if [ -f "$CORPUS/$NAME.budget" ] ; then
+		LIMIT="$(cat "$CORPUS/$NAME.budget")"
+	fi
+
+	for LANGUAGE in bf ig ; do
+		if [ "$LANGUAGE" = "bf" ] ; then
+			INTERPRETER="./brainfuck"
+		else
+			INTERPRETER="./ichiglyph"
+		fi
+
+		for ENGINE in $ENGINES ; do
+			"$INTERPRETER" --engine="$ENGINE" --no-fold --counters \
+			    --budget="$LIMIT" "examples/$NAME.$LANGUAGE" < "$INPUT" \
+			    > "$WORK/output" 2> "$WORK/counters"
+
+			RET="$?"
+
+			if [ "$RET" -ne 0 ] && [ "$RET" -ne 7 ] ; then
+				echo "$NAME.$LANGUAGE.$ENGINE: error (exit code $RET)"
+				FAILED=1
+				continue
+			fi
+
+			if ! cmp -s "$WORK/output" "$CORPUS/$NAME.out" ; then
+				echo "$NAME.$LANGUAGE.$ENGINE: output mismatch"
+				FAILED=1
+				continue
+			fi
+
+			#
+			# The counters are the last line of the standard
+			# error output.
+			#
+			tail -n 1 "$WORK/counters" | awk -v name="$NAME" \
+			    -v language="$LANGUAGE" -v engine="$ENGINE" '{
+				split($0, field, ", ")
+				split(field[1], instructions, " ")
+				split(field[2], span, " ")
+				split(field[3], input, " ")
+				split(field[4], output, " ")
+
+				printf("%s,%s,%s,%s,%s,%s,%s\n", name, language, engine,
+				    instructions[2], span[1], input[1], output[1])
+			}' >> "$WORK/current"
+		done
+	done
+done < examples/list.csv
+
+if [ "$UPDATE" = "1" ] ; then
+	cp "$WORK/current" "$BASELINE"
+	cat "$BASELINE"
+	exit "$FAILED"
+fi
+
+if [ ! -f "$BASELINE" ] ; then
+	echo "$BASELINE: Missing baseline"
+	exit 1
+fi
+
+#
+# Each counter is compared with the baseline of the same program,
+# language and engine. The improvements are reported as well, thus
+# the baseline can be tightened.
+#
+awk -F ',' 'NR == FNR {
+	if (FNR == 1) {
+		for (i = 4; i <= NF; i++)
+			key[i] = $i
+	} else
+		baseline[$1 "." $2 "." $3] = $0
+
+	next
+}
+FNR > 1 {
+	name = $1 "." $2 "." $3
+	if (!(name in baseline)) {
+		printf("%s: missing in the baseline\n", name)
+		failed = 1
+		next
+	}
+
+	split(baseline[name], base, ",")
+	status = "ok"
+
+	for (i = 4; i <= NF; i++) {
+		if ($i + 0 > base[i] + 0) {
+			printf("%s: %s regressed from %s to %s\n", name, key[i],
+			    base[i], $i)
+			status = "regressed"
+			failed = 1
+		} else if ($i + 0 < base[i] + 0) {
+			printf("%s: %s improved from %s to %s\n", name, key[i],
+			    base[i], $i)
+			if (status == "ok")
+				status = "improved"
+		}
+	}
+
+	printf("%s: %s\n", name, status)
+}
+END {
+	exit failed
+}' "$BASELINE" "$WORK/current" || FAILED=1
+
+exit "$FAILED"
@@ -0,0 +1,203 @@
+#!/bin/sh
+#
+# Copyright (c) 2017 Martin Decky
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+#
+# - Redistributions of source code must retain the above copyright
+#   notice, this list of conditions and the following disclaimer.
+# - Redistributions in binary form must reproduce the above copyright
+#   notice, this list of conditions and the following disclaimer in the
+#   documentation and/or other materials provided with the distribution.
+# - The name of the author may not be used to endorse or promote products
+#   derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+# IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+# OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+# IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+# INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+# NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+# THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#
+
+#
+#
+# Run the sample programs listed in examples/list.csv and the test
+# programs in benchmark/test (both their Brainfuck and Ichiglyph
+# forms) using each execution engine and each tape mode and verify
+# their output. The test programs cover the corner cases that the
+# sample programs do not (e.g. moving the data pointer far to the
+# left of the origin).
+#
+# The beginning of the programs that does not depend on the input
+# is not evaluated in advance (--no-fold), otherwise the engines
+# would have nothing to execute for most of the programs. The
+# evaluation in advance is covered by a round-trip through the
+# daemon (igd) and its client (igc) in each tape mode, which also
+# executes each cached program again by its hash.
+#
+# The inputs, expected outputs and budgets of the sample programs
+# come from benchmark/corpus (see bench.sh), the test programs keep
+# them next to their sources.
+#
+# Usage: test.sh
+#
+# The engines and the tape modes can be selected by the ENGINES and
+# TAPES environment variables (all of them by default). The script
+# fails if the output of any execution does not match.
+#
+
+ENGINES="${ENGINES:-switch threaded jit tiered lockstep}"
+TAPES="${TAPES:-virtual dynamic}"
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+mkdir "$WORK/batch"
+
+FAILED=0
+
+#
+# Verify the exit code and the output of an execution (the
+# budget is exhausted only if the program has a budget).
+#
+verify() {
+	if [ "$1" -ne 0 ] && { [ "$1" -ne 7 ] || [ -z "$LIMIT" ] ; } ; then
+		echo "$2: error (exit code $1)"
+		FAILED=1
+	elif ! cmp -s "$WORK/output" "$EXPECTED.out" ; then
+		echo "$2: output mismatch"
+		FAILED=1
+	else
+		echo "$2: ok"
+	fi
+}
+
+#
+# Each line of the list is the directory of the sources, the
+# directory of the expectations and the name of the program.
+#
+{
+	while read -r NAME ; do
+		if [ -n "$NAME" ] ; then
+			echo "examples benchmark/corpus $NAME"
+		fi
+	done < examples/list.csv
+
+	for SOURCE in benchmark/test/*.bf ; do
+		echo "benchmark/test benchmark/test $(basename "$SOURCE" .bf)"
+	done
+} > "$WORK/list"
+
+while read -r SOURCES EXPECTATIONS NAME ; do
+	EXPECTED="$EXPECTATIONS/$NAME"
+
+	INPUT="$EXPECTED.in"
+	if [ ! -f "$INPUT" ] ; then
+		INPUT="/dev/null"
+	fi
+
+	LIMIT=""
+	if [ -f "$EXPECTED.budget" ] ; then
+		LIMIT="$(cat "$EXPECTED.budget")"
+	fi
+
+	for LANGUAGE in bf ig ; do
+		if [ "$LANGUAGE" = "bf" ] ; then
+			INTERPRETER="./brainfuck"
+		else
+			INTERPRETER="./ichiglyph"
+		fi
+
+		for TAPE in $TAPES ; do
+			for ENGINE in $ENGINES ; do
+				#
+				# The lockstep engine executes only batches,
+				# thus the input is supplied as a batch of
+				# one file.
+				#
+				if [ "$ENGINE" = "lockstep" ] ; then
+					cp "$INPUT" "$WORK/batch/input"
+					"$INTERPRETER" --engine="$ENGINE" --tape="$TAPE" \
+					    --no-fold ${LIMIT:+--budget="$LIMIT"} \
+					    --batch="$WORK/batch" --threads=1 \
+					    "$SOURCES/$NAME.$LANGUAGE" > "$WORK/output" \
+					    2> "$WORK/errors"
+				else
+					"$INTERPRETER" --engine="$ENGINE" --tape="$TAPE" \
+					    --no-fold ${LIMIT:+--budget="$LIMIT"} \
+					    "$SOURCES/$NAME.$LANGUAGE" < "$INPUT" > "$WORK/output" \
+					    2> "$WORK/errors"
+				fi
+
+				verify "$?" "$NAME.$LANGUAGE.$ENGINE.$TAPE"
+			done
+		done
+	done
+done < "$WORK/list"
+
+for TAPE in $TAPES ; do
+	SOCKET="$WORK/igd.sock"
+
+	./igd --socket="$SOCKET" --tape="$TAPE" &
+	DAEMON="$!"
+
+	#
+	# Wait for the daemon to start listening.
+	#
+	WAIT=0
+	while [ ! -S "$SOCKET" ] && [ "$WAIT" -lt 50 ] ; do
+		sleep 0.1
+		WAIT=$((WAIT + 1))
+	done
+
+	while read -r SOURCES EXPECTATIONS NAME ; do
+		EXPECTED="$EXPECTATIONS/$NAME"
+
+		INPUT="$EXPECTED.in"
+		if [ ! -f "$INPUT" ] ; then
+			INPUT="/dev/null"
+		fi
+
+		LIMIT=""
+		if [ -f "$EXPECTED.budget" ] ; then
+			LIMIT="$(cat "$EXPECTED.budget")"
+		fi
+
+		for LANGUAGE in bf ig ; do
+			if [ "$LANGUAGE" = "bf" ] ; then
+				DIALECT="--brainfuck"
+			else
+				DIALECT=""
+			fi
+
+			./igc --socket="$SOCKET" $DIALECT ${LIMIT:+--budget="$LIMIT"} \
+			    --print-hash "$SOURCES/$NAME.$LANGUAGE" < "$INPUT" \
+			    > "$WORK/output" 2> "$WORK/hash"
+
+			verify "$?" "$NAME.$LANGUAGE.igd.$TAPE"
+
+			#
+			# The hash is the first line of the standard error
+			# output (followed by the budget exhaustion).
+			#
+			./igc --socket="$SOCKET" ${LIMIT:+--budget="$LIMIT"} \
+			    --hash="$(head -n 1 "$WORK/hash")" < "$INPUT" \
+			    > "$WORK/output" 2> "$WORK/errors"
+
+			verify "$?" "$NAME.$LANGUAGE.igd.$TAPE.hash"
+		done
+	done < "$WORK/list"
+
+	kill "$DAEMON"
+	wait "$DAEMON" 2> /dev/null
+	rm -f "$SOCKET"
+done
+
+exit "$FAILED"
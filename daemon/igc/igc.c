@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is the client of the Ichiglyph daemon. It asks the daemon
+ * to execute a program with the standard input and output of the
+ * client (see the protocol.h for details) and it exits with the
+ * same exit code as the interpreter would.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <ichiglyph.h>
+#include "../protocol.h"
+
+/** Exit code if the daemon is not available */
+#define EXIT_UNAVAILABLE  9
+
+/** Send a request
+ *
+ * The standard input and output are passed along with the
+ * request.
+ *
+ * @param sock    Connected socket.
+ * @param request Request.
+ * @param path    Path of the program.
+ *
+ * @return True if the request has been sent.
+ *
+ */
+static bool request_send(int sock, igd_request_t *request, const char *path)
+{
+	union {
+		struct cmsghdr header;
+		uint8_t buffer[CMSG_SPACE(2 * sizeof(int))];
+	} control;
+	
+	memset(&control, 0, sizeof(control));
+	
+	struct iovec iov[2] = {
+		{
+			.iov_base = request,
+			.iov_len = sizeof(igd_request_t)
+		},
+		{
+			.iov_base = (void *) path,
+			.iov_len = request->path_size
+		}
+	};
+	
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 2;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+	
+	int fds[2] = {
+		STDIN_FILENO,
+		STDOUT_FILENO
+	};
+	
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	
+	size_t size = sizeof(igd_request_t) + request->path_size;
+	ssize_t ret;
+	
+	do {
+		ret = sendmsg(sock, &msg, MSG_NOSIGNAL);
+	} while ((ret < 0) && (errno == EINTR));
+	
+	return (ret == (ssize_t) size);
+}
+
+/** Print usage
+ *
+ * @param name Name of the executable.
+ *
+ */
+static void usage(const char *name)
+{
+	fprintf(stderr, "Syntax: %s [<options>] <source>\n", name);
+	fprintf(stderr, "        %s [<options>] --hash=<hash>\n", name);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --socket=<path>    Connect to the Unix domain socket (default is\n");
+	fprintf(stderr, "                     /tmp/ichiglyph-<uid>.sock)\n");
+	fprintf(stderr, "  --brainfuck        The program is a Brainfuck program (the\n");
+	fprintf(stderr, "                     program is an Ichiglyph program by default)\n");
+	fprintf(stderr, "  --budget=<n>       Stop after executing about <n> compiled\n");
+	fprintf(stderr, "                     instructions\n");
+	fprintf(stderr, "  --hash=<hash>      Execute the cached program with the hash\n");
+	fprintf(stderr, "                     instead of a source file\n");
+	fprintf(stderr, "  --print-hash       Print the hash of the program to the standard\n");
+	fprintf(stderr, "                     error output\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	igd_socket_default(addr.sun_path, sizeof(addr.sun_path));
+	
+	igd_request_t request;
+	memset(&request, 0, sizeof(request));
+	request.magic = IGD_MAGIC;
+	request.language = ICHIGLYPH_LANGUAGE_ICHIGLYPH;
+	
+	bool print_hash = false;
+	int arg = 1;
+	
+	while ((arg < argc) && (strncmp(argv[arg], "--", 2) == 0)) {
+		char *end;
+		
+		if (strncmp(argv[arg], "--socket=", 9) == 0) {
+			if (strlen(argv[arg] + 9) >= sizeof(addr.sun_path)) {
+				fprintf(stderr, "%s: Path too long\n", argv[arg]);
+				return 1;
+			}
+			
+			strcpy(addr.sun_path, argv[arg] + 9);
+		} else if (strcmp(argv[arg], "--brainfuck") == 0)
+			request.language = ICHIGLYPH_LANGUAGE_BRAINFUCK;
+		else if (strncmp(argv[arg], "--budget=", 9) == 0) {
+			request.budget = strtoull(argv[arg] + 9, &end, 10);
+			if ((request.budget == 0) || (*end != 0)) {
+				fprintf(stderr, "%s: Invalid budget\n", argv[arg]);
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (strncmp(argv[arg], "--hash=", 7) == 0) {
+			request.hash = strtoull(argv[arg] + 7, &end, 16);
+			if ((argv[arg][7] == 0) || (*end != 0)) {
+				fprintf(stderr, "%s: Invalid hash\n", argv[arg]);
+				usage(argv[0]);
+				return 1;
+			}
+			
+			request.by_hash = true;
+		} else if (strcmp(argv[arg], "--print-hash") == 0)
+			print_hash = true;
+		else {
+			fprintf(stderr, "%s: Unknown option\n", argv[arg]);
+			usage(argv[0]);
+			return 1;
+		}
+		
+		arg++;
+	}
+	
+	if ((!request.by_hash) && (arg >= argc)) {
+		usage(argv[0]);
+		return 1;
+	}
+	
+	/*
+	 * The daemon opens the source file, thus the path needs to
+	 * be absolute.
+	 */
+	char path[PATH_MAX];
+	const char *name = argv[arg];
+	char hash_name[17];
+	
+	if (request.by_hash) {
+		snprintf(hash_name, sizeof(hash_name), "%016" PRIx64, request.hash);
+		name = hash_name;
+		path[0] = 0;
+	} else {
+		if ((realpath(name, path) == NULL) ||
+		    (strlen(path) > IGD_PATH_MAX)) {
+			fprintf(stderr, "%s: Unable to open\n", name);
+			return 2;
+		}
+		
+		request.path_size = strlen(path);
+	}
+	
+	int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if ((sock < 0) ||
+	    (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0)) {
+		fprintf(stderr, "%s: Unable to connect\n", addr.sun_path);
+		return EXIT_UNAVAILABLE;
+	}
+	
+	igd_response_t response;
+	if ((!request_send(sock, &request, path)) ||
+	    (recv(sock, &response, sizeof(response), MSG_WAITALL) !=
+	    sizeof(response))) {
+		fprintf(stderr, "%s: Connection failed\n", addr.sun_path);
+		close(sock);
+		return EXIT_UNAVAILABLE;
+	}
+	
+	close(sock);
+	
+	if (print_hash)
+		fprintf(stderr, "%016" PRIx64 "\n", response.hash);
+	
+	switch (response.status) {
+	case 2:
+		fprintf(stderr, "%s: Unable to open\n", name);
+		break;
+	case 3:
+		fprintf(stderr, "%s: Unable to stat\n", name);
+		break;
+	case 4:
+		fprintf(stderr, "%s: Unable to mmap\n", name);
+		break;
+	case 5:
+		if (response.unmatched_valid)
+			fprintf(stderr, "%s: Unmatched bracket at instruction %" PRIu64
+			    "\n", name, response.unmatched);
+		else
+			fprintf(stderr, "%s: Out of memory\n", name);
+		
+		break;
+	case 6:
+		fprintf(stderr, "%s: Out of memory\n", name);
+		break;
+	case 7:
+		fprintf(stderr, "%s: Budget exhausted\n", name);
+		break;
+	case IGD_UNKNOWN:
+		fprintf(stderr, "%s: Unknown program\n", name);
+		break;
+	}
+	
+	return response.status;
+}
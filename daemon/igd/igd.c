@@ -0,0 +1,969 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is the Ichiglyph daemon. It listens on a Unix domain socket
+ * and executes the programs requested by the clients (see the
+ * protocol.h for details) using the file descriptors passed by
+ * the clients as the input and output. This saves the start-up
+ * cost of the interpreter (including the compilation of the
+ * program) on each invocation.
+ *
+ * The compiled programs are kept in a cache keyed by the hash of
+ * the program source (along with the source itself, since the hash
+ * may collide) and the least recently used programs are evicted.
+ * Each connection is served by its own thread and the virtual
+ * machines are reused between the requests.
+ *
+ * The programs are opened with the privileges of the daemon, thus
+ * the socket is accessible only by the owner of the daemon.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <ichiglyph.h>
+#include "../protocol.h"
+
+/** Default number of the cached compiled programs */
+#define CACHE_SIZE  64
+
+/** Number of the idle virtual machines kept for reuse */
+#define VM_POOL_SIZE  16
+
+/** Minimal number of bytes copied by the kernel */
+#define COPY_THRESHOLD  65536
+
+/** Cached compiled program */
+typedef struct cache_entry {
+	/** Previous (more recently used) cached program */
+	struct cache_entry *prev;
+
+	/** Next (less recently used) cached program */
+	struct cache_entry *next;
+
+	/** Hash of the program */
+	uint64_t hash;
+
+	/** Language of the program (ichiglyph_language_t) */
+	uint8_t language;
+
+	/** Source of the program (the hash alone may collide) */
+	uint8_t *source;
+
+	/** Size of the source of the program */
+	size_t source_size;
+
+	/** Compiled program */
+	ichiglyph_program_t *program;
+
+	/** Number of references (the cache holds one reference) */
+	size_t refs;
+} cache_entry_t;
+
+/** Standard input and output of a client */
+typedef struct {
+	/** Input file descriptor */
+	int input;
+
+	/** Output file descriptor */
+	int output;
+
+	/** Mapped input bytes (NULL if the input is not mapped) */
+	const uint8_t *data;
+
+	/** Size of the mapping */
+	size_t size;
+
+	/** Offset of the input in the mapping */
+	size_t offset;
+
+	/** Whether the output is a regular file */
+	bool regular;
+} stream_t;
+
+/** Lock protecting the cache */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Most recently used cached program */
+static cache_entry_t *cache_head = NULL;
+
+/** Least recently used cached program */
+static cache_entry_t *cache_tail = NULL;
+
+/** Number of the cached programs */
+static size_t cache_count = 0;
+
+/** Maximal number of the cached programs */
+static size_t cache_limit = CACHE_SIZE;
+
+/** Lock protecting the virtual machine pool */
+static pthread_mutex_t vm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Idle virtual machines */
+static ichiglyph_vm_t *vm_pool[VM_POOL_SIZE];
+
+/** Number of the idle virtual machines */
+static size_t vm_count = 0;
+
+/** Execution engine */
+static ichiglyph_engine_t engine = ICHIGLYPH_ENGINE_THREADED;
+
+/** Data memory mode (the daemon does not handle SIGSEGV and SIGBUS
+    itself, thus it opts in to the virtual data memory by default) */
+static ichiglyph_tape_t tape = ICHIGLYPH_TAPE_VIRTUAL;
+
+/** Perf output of the native code (ichiglyph_perf_t flags) */
+static unsigned int perf = ICHIGLYPH_PERF_NONE;
+
+/** Unlink a program from the cache
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param entry Cached program.
+ *
+ */
+static void cache_unlink(cache_entry_t *entry)
+{
+	if (entry->prev != NULL)
+		entry->prev->next = entry->next;
+	else
+		cache_head = entry->next;
+	
+	if (entry->next != NULL)
+		entry->next->prev = entry->prev;
+	else
+		cache_tail = entry->prev;
+	
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+/** Link a program to the front of the cache
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param entry Cached program.
+ *
+ */
+static void cache_link(cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache_head;
+	
+	if (cache_head != NULL)
+		cache_head->prev = entry;
+	else
+		cache_tail = entry;
+	
+	cache_head = entry;
+}
+
+/** Drop a reference to a cached program
+ *
+ * Must be called with the cache lock held.
+ *
+ * @param entry Cached program.
+ *
+ */
+static void cache_put(cache_entry_t *entry)
+{
+	if (--entry->refs == 0) {
+		ichiglyph_program_destroy(entry->program);
+		free(entry->source);
+		free(entry);
+	}
+}
+
+/** Check whether a cached program has the given source
+ *
+ * @param entry       Cached program.
+ * @param language    Language of the program.
+ * @param source      Source of the program.
+ * @param source_size Size of the source of the program.
+ *
+ * @return True if the cached program has the source.
+ *
+ */
+static bool cache_match(cache_entry_t *entry, uint8_t language,
+    const uint8_t *source, size_t source_size)
+{
+	return ((entry->language == language) &&
+	    (entry->source_size == source_size) &&
+	    ((source_size == 0) ||
+	    (memcmp(entry->source, source, source_size) == 0)));
+}
+
+/** Look up a cached program
+ *
+ * The program found becomes the most recently used one. The
+ * programs identified by their path are also compared by their
+ * source, since different sources may have the same hash.
+ *
+ * @param hash        Hash of the program.
+ * @param by_hash     Whether the program is identified only by
+ *                    its hash.
+ * @param language    Language of the program (unless identified
+ *                    only by its hash).
+ * @param source      Source of the program (unless identified
+ *                    only by its hash).
+ * @param source_size Size of the source of the program (unless
+ *                    identified only by its hash).
+ *
+ * @return Cached program (with a reference to be dropped by
+ *         cache_release()) or NULL if not found.
+ *
+ */
+static cache_entry_t *cache_lookup(uint64_t hash, bool by_hash,
+    uint8_t language, const uint8_t *source, size_t source_size)
+{
+	pthread_mutex_lock(&cache_lock);
+	
+	cache_entry_t *entry = cache_head;
+	while ((entry != NULL) && ((entry->hash != hash) || ((!by_hash) &&
+	    (!cache_match(entry, language, source, source_size)))))
+		entry = entry->next;
+	
+	if (entry != NULL) {
+		cache_unlink(entry);
+		cache_link(entry);
+		entry->refs++;
+	}
+	
+	pthread_mutex_unlock(&cache_lock);
+	return entry;
+}
+
+/** Insert a compiled program into the cache
+ *
+ * The least recently used programs are evicted if the cache
+ * is full. If the program has been inserted in the meantime
+ * by another thread, the cached program is used instead. A cached
+ * program with the same hash but a different source is evicted,
+ * thus the hash identifies at most one cached program.
+ *
+ * @param hash        Hash of the program.
+ * @param language    Language of the program.
+ * @param source      Source of the program (copied by the cache).
+ * @param source_size Size of the source of the program.
+ * @param program     Compiled program (taken over by the cache).
+ *
+ * @return Cached program (with a reference to be dropped by
+ *         cache_release()) or NULL on an out-of-memory condition.
+ *
+ */
+static cache_entry_t *cache_insert(uint64_t hash, uint8_t language,
+    const uint8_t *source, size_t source_size, ichiglyph_program_t *program)
+{
+	cache_entry_t *entry = cache_lookup(hash, false, language, source,
+	    source_size);
+	if (entry != NULL) {
+		ichiglyph_program_destroy(program);
+		return entry;
+	}
+	
+	entry = (cache_entry_t *) malloc(sizeof(cache_entry_t));
+	if (entry == NULL) {
+		ichiglyph_program_destroy(program);
+		return NULL;
+	}
+	
+	entry->source = NULL;
+	if (source_size > 0) {
+		entry->source = (uint8_t *) malloc(source_size);
+		if (entry->source == NULL) {
+			ichiglyph_program_destroy(program);
+			free(entry);
+			return NULL;
+		}
+		
+		memcpy(entry->source, source, source_size);
+	}
+	
+	entry->hash = hash;
+	entry->language = language;
+	entry->source_size = source_size;
+	entry->program = program;
+	entry->refs = 2;
+	
+	pthread_mutex_lock(&cache_lock);
+	
+	cache_entry_t *collision = cache_head;
+	while ((collision != NULL) && (collision->hash != hash))
+		collision = collision->next;
+	
+	if (collision != NULL) {
+		cache_unlink(collision);
+		cache_count--;
+		cache_put(collision);
+	}
+	
+	cache_link(entry);
+	cache_count++;
+	
+	while (cache_count > cache_limit) {
+		cache_entry_t *victim = cache_tail;
+		
+		cache_unlink(victim);
+		cache_count--;
+		cache_put(victim);
+	}
+	
+	pthread_mutex_unlock(&cache_lock);
+	return entry;
+}
+
+/** Release a cached program
+ *
+ * @param entry Cached program.
+ *
+ */
+static void cache_release(cache_entry_t *entry)
+{
+	pthread_mutex_lock(&cache_lock);
+	cache_put(entry);
+	pthread_mutex_unlock(&cache_lock);
+}
+
+/** Get a virtual machine
+ *
+ * @return Idle or new virtual machine (NULL on an out-of-memory
+ *         condition).
+ *
+ */
+static ichiglyph_vm_t *vm_acquire(void)
+{
+	ichiglyph_vm_t *vm = NULL;
+	
+	pthread_mutex_lock(&vm_lock);
+	if (vm_count > 0)
+		vm = vm_pool[--vm_count];
+	pthread_mutex_unlock(&vm_lock);
+	
+	if (vm == NULL) {
+		vm = ichiglyph_vm_create(engine, tape);
+		if (vm != NULL)
+			ichiglyph_vm_set_perf(vm, perf);
+	}
+	
+	return vm;
+}
+
+/** Return a virtual machine
+ *
+ * @param vm Virtual machine no longer used.
+ *
+ */
+static void vm_release(ichiglyph_vm_t *vm)
+{
+	pthread_mutex_lock(&vm_lock);
+	
+	if (vm_count < VM_POOL_SIZE) {
+		vm_pool[vm_count++] = vm;
+		vm = NULL;
+	}
+	
+	pthread_mutex_unlock(&vm_lock);
+	
+	if (vm != NULL)
+		ichiglyph_vm_destroy(vm);
+}
+
+/** Write bytes to a file descriptor
+ *
+ * @param fd    File descriptor.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+static void fd_write(int fd, const uint8_t *bytes, size_t count)
+{
+	size_t pos = 0;
+	
+	while (pos < count) {
+		ssize_t ret = write(fd, bytes + pos, count - pos);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			
+			break;
+		}
+		
+		pos += ret;
+	}
+}
+
+/** Read the input of a client
+ *
+ * @param arg   Standard input and output of the client.
+ * @param bytes Buffer for the input bytes.
+ * @param count Size of the buffer.
+ *
+ * @return Number of bytes read, 0 on the end of the input or
+ *         negative value on an error.
+ *
+ */
+static ssize_t stream_read(void *arg, uint8_t *bytes, size_t count)
+{
+	stream_t *stream = (stream_t *) arg;
+	
+	while (true) {
+		ssize_t ret = read(stream->input, bytes, count);
+		if ((ret < 0) && (errno == EINTR))
+			continue;
+		
+		return ret;
+	}
+}
+
+/** Write the output of a client
+ *
+ * Long runs of the bytes of the mapped input are copied by the
+ * kernel (using copy_file_range(2) or sendfile(2)) without
+ * passing through the user space.
+ *
+ * @param arg   Standard input and output of the client.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+static void stream_write(void *arg, const uint8_t *bytes, size_t count)
+{
+	stream_t *stream = (stream_t *) arg;
+	
+	if ((stream->data != NULL) && (count >= COPY_THRESHOLD) &&
+	    (bytes >= stream->data) &&
+	    (bytes + count <= stream->data + stream->size)) {
+		off_t offset = bytes - stream->data;
+		
+		while (count > 0) {
+			ssize_t ret = -1;
+			
+			if (stream->regular) {
+				ret = copy_file_range(stream->input, &offset,
+				    stream->output, NULL, count, 0);
+				if (ret < 0)
+					stream->regular = false;
+			}
+			
+			if (ret < 0)
+				ret = sendfile(stream->output, stream->input, &offset,
+				    count);
+			
+			if (ret <= 0)
+				break;
+			
+			count -= ret;
+		}
+		
+		bytes = stream->data + offset;
+	}
+	
+	fd_write(stream->output, bytes, count);
+}
+
+/** Map the input of a client
+ *
+ * If the input is a regular file, it is mapped into the memory
+ * and consumed directly from the mapping starting at the current
+ * file offset.
+ *
+ * @param stream Standard input and output of the client.
+ *
+ * @return True if the input has been mapped.
+ *
+ */
+static bool stream_map(stream_t *stream)
+{
+	struct stat st;
+	
+	stream->data = NULL;
+	stream->size = 0;
+	stream->offset = 0;
+	stream->regular = ((fstat(stream->output, &st) == 0) &&
+	    (S_ISREG(st.st_mode)));
+	
+	if ((fstat(stream->input, &st) != 0) || (!S_ISREG(st.st_mode)))
+		return false;
+	
+	off_t offset = lseek(stream->input, 0, SEEK_CUR);
+	if ((offset < 0) || (offset >= st.st_size) ||
+	    ((uintmax_t) st.st_size > SIZE_MAX))
+		return false;
+	
+	void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+	    stream->input, 0);
+	if (mapped == MAP_FAILED)
+		return false;
+	
+	(void) madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+	
+	stream->data = (const uint8_t *) mapped;
+	stream->size = st.st_size;
+	stream->offset = offset;
+	return true;
+}
+
+/** Unmap the input of a client
+ *
+ * The offset of the input is left right after the last input
+ * byte consumed from the mapping.
+ *
+ * @param stream   Standard input and output of the client.
+ * @param consumed Number of the consumed input bytes.
+ *
+ */
+static void stream_unmap(stream_t *stream, size_t consumed)
+{
+	if (stream->data == NULL)
+		return;
+	
+	if (consumed > 0)
+		(void) lseek(stream->input, stream->offset + consumed, SEEK_SET);
+	
+	munmap((void *) stream->data, stream->size);
+	stream->data = NULL;
+}
+
+/** Get the compiled program of a request
+ *
+ * @param request  Request.
+ * @param path     Path of the program (NUL-terminated).
+ * @param response Response (the status is set on failure).
+ *
+ * @return Cached program (with a reference to be dropped by
+ *         cache_release()) or NULL on failure.
+ *
+ */
+static cache_entry_t *request_program(igd_request_t *request,
+    const char *path, igd_response_t *response)
+{
+	if (request->by_hash) {
+		response->hash = request->hash;
+		
+		cache_entry_t *entry = cache_lookup(request->hash, true, 0, NULL, 0);
+		if (entry == NULL)
+			response->status = IGD_UNKNOWN;
+		
+		return entry;
+	}
+	
+	int source = open(path, O_RDONLY);
+	if (source < 0) {
+		response->status = 2;
+		return NULL;
+	}
+	
+	struct stat stat;
+	if (fstat(source, &stat) != 0) {
+		close(source);
+		response->status = 3;
+		return NULL;
+	}
+	
+	size_t source_size = stat.st_size;
+	void *program = NULL;
+	
+	if (source_size > 0) {
+		program = mmap(NULL, source_size, PROT_READ, MAP_PRIVATE, source, 0);
+		if (program == MAP_FAILED) {
+			close(source);
+			response->status = 4;
+			return NULL;
+		}
+	}
+	
+	/*
+	 * The compilation is skipped if the program with the same
+	 * source is already cached.
+	 */
+	uint64_t hash = igd_hash(IGD_HASH_BASIS, &request->language, 1);
+	hash = igd_hash(hash, (const uint8_t *) program, source_size);
+	response->hash = hash;
+	
+	cache_entry_t *entry = cache_lookup(hash, false, request->language,
+	    (const uint8_t *) program, source_size);
+	if (entry == NULL) {
+		ichiglyph_program_t *compiled;
+		size_t unmatched;
+		ichiglyph_result_t result = ichiglyph_program_compile(
+		    (ichiglyph_language_t) request->language, program, source_size,
+		    true, &compiled, &unmatched);
+		
+		if (result == ICHIGLYPH_OK) {
+			entry = cache_insert(hash, request->language,
+			    (const uint8_t *) program, source_size, compiled);
+			if (entry == NULL)
+				response->status = 5;
+		} else {
+			if (result == ICHIGLYPH_UNMATCHED) {
+				response->unmatched_valid = true;
+				response->unmatched = unmatched;
+			}
+			
+			response->status = 5;
+		}
+	}
+	
+	if (program != NULL)
+		munmap(program, source_size);
+	
+	close(source);
+	return entry;
+}
+
+/** Execute a request
+ *
+ * @param request  Request.
+ * @param path     Path of the program (NUL-terminated).
+ * @param fds      Standard input and output of the client.
+ * @param response Response.
+ *
+ */
+static void request_execute(igd_request_t *request, const char *path,
+    int fds[2], igd_response_t *response)
+{
+	cache_entry_t *entry = request_program(request, path, response);
+	if (entry == NULL)
+		return;
+	
+	ichiglyph_vm_t *vm = vm_acquire();
+	if (vm == NULL) {
+		cache_release(entry);
+		response->status = 6;
+		return;
+	}
+	
+	stream_t stream;
+	stream.input = fds[0];
+	stream.output = fds[1];
+	
+	if (stream_map(&stream))
+		ichiglyph_vm_set_input_memory(vm, stream.data + stream.offset,
+		    stream.size - stream.offset);
+	else
+		ichiglyph_vm_set_input(vm, stream_read, &stream);
+	
+	ichiglyph_vm_set_output(vm, stream_write, &stream,
+	    isatty(stream.output) ? ICHIGLYPH_BUFFER_LINE : ICHIGLYPH_BUFFER_FULL);
+	
+	ichiglyph_result_t result = ichiglyph_vm_run(vm, entry->program,
+	    request->budget);
+	stream_unmap(&stream, ichiglyph_vm_consumed(vm));
+	
+	/*
+	 * The virtual machine must not keep the references to the
+	 * input and output of the client.
+	 */
+	ichiglyph_vm_set_input(vm, NULL, NULL);
+	ichiglyph_vm_set_output(vm, NULL, NULL, ICHIGLYPH_BUFFER_FULL);
+	vm_release(vm);
+	cache_release(entry);
+	
+	if (result == ICHIGLYPH_OUT_OF_MEMORY)
+		response->status = 6;
+	else if (result == ICHIGLYPH_BUDGET)
+		response->status = 7;
+}
+
+/** Receive a request
+ *
+ * @param sock    Connected socket.
+ * @param request Request.
+ * @param path    Buffer for the path of the program (at least
+ *                IGD_PATH_MAX + 1 bytes).
+ * @param fds     Passed standard input and output.
+ *
+ * @return True if a valid request has been received.
+ *
+ */
+static bool request_receive(int sock, igd_request_t *request, char *path,
+    int fds[2])
+{
+	union {
+		struct cmsghdr header;
+		uint8_t buffer[CMSG_SPACE(2 * sizeof(int))];
+	} control;
+	
+	struct iovec iov = {
+		.iov_base = request,
+		.iov_len = sizeof(igd_request_t)
+	};
+	
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	
+	ssize_t ret;
+	do {
+		ret = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+	} while ((ret < 0) && (errno == EINTR));
+	
+	if (ret <= 0)
+		return false;
+	
+	/*
+	 * The file descriptors arrive with the first byte of the
+	 * request.
+	 */
+	fds[0] = -1;
+	fds[1] = -1;
+	
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	if ((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) &&
+	    (cmsg->cmsg_type == SCM_RIGHTS)) {
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int passed[2];
+		
+		memcpy(passed, CMSG_DATA(cmsg), ((count < 2) ? count : 2) *
+		    sizeof(int));
+		
+		if (count == 2) {
+			fds[0] = passed[0];
+			fds[1] = passed[1];
+		} else if (count == 1)
+			close(passed[0]);
+	}
+	
+	if ((ret < (ssize_t) sizeof(igd_request_t)) &&
+	    (recv(sock, (uint8_t *) request + ret, sizeof(igd_request_t) - ret,
+	    MSG_WAITALL) != (ssize_t) sizeof(igd_request_t) - ret))
+		goto error;
+	
+	if ((fds[0] < 0) || (request->magic != IGD_MAGIC) ||
+	    (request->language > ICHIGLYPH_LANGUAGE_BRAINFUCK) ||
+	    (request->path_size > IGD_PATH_MAX))
+		goto error;
+	
+	if ((request->path_size > 0) &&
+	    (recv(sock, path, request->path_size, MSG_WAITALL) !=
+	    request->path_size))
+		goto error;
+	
+	path[request->path_size] = 0;
+	return true;
+	
+error:
+	if (fds[0] >= 0) {
+		close(fds[0]);
+		close(fds[1]);
+	}
+	
+	return false;
+}
+
+/** Serve a connection
+ *
+ * @param arg Connected socket.
+ *
+ * @return NULL.
+ *
+ */
+static void *connection_serve(void *arg)
+{
+	int sock = (int) (intptr_t) arg;
+	char path[IGD_PATH_MAX + 1];
+	igd_request_t request;
+	int fds[2];
+	
+	while (request_receive(sock, &request, path, fds)) {
+		igd_response_t response;
+		memset(&response, 0, sizeof(response));
+		
+		request_execute(&request, path, fds, &response);
+		close(fds[0]);
+		close(fds[1]);
+		
+		if (send(sock, &response, sizeof(response), MSG_NOSIGNAL) !=
+		    sizeof(response))
+			break;
+	}
+	
+	close(sock);
+	return NULL;
+}
+
+/** Print usage
+ *
+ * @param name Name of the executable.
+ *
+ */
+static void usage(const char *name)
+{
+	fprintf(stderr, "Syntax: %s [<options>]\n", name);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --socket=<path>    Listen on the Unix domain socket (default is\n");
+	fprintf(stderr, "                     /tmp/ichiglyph-<uid>.sock)\n");
+	fprintf(stderr, "  --cache=<n>        Number of the cached compiled programs\n");
+	fprintf(stderr, "                     (default is %u)\n", CACHE_SIZE);
+	fprintf(stderr, "  --engine=switch    Use the switch-based engine\n");
+	fprintf(stderr, "  --engine=threaded  Use the direct-threaded engine (default)\n");
+	fprintf(stderr, "  --engine=jit       Use the x86-64 JIT compiler (falls back to\n");
+	fprintf(stderr, "                     the direct-threaded engine if unavailable)\n");
+	fprintf(stderr, "  --engine=tiered    Use the direct-threaded engine and compile\n");
+	fprintf(stderr, "                     the hot loops using the x86-64 JIT compiler\n");
+	fprintf(stderr, "  --tape=virtual     Reserve virtual data memory with guard areas\n");
+	fprintf(stderr, "                     (default, falls back to the dynamic data\n");
+	fprintf(stderr, "                     memory if unavailable)\n");
+	fprintf(stderr, "  --tape=dynamic     Resize the data memory on demand\n");
+	fprintf(stderr, "  --perf-map         Write the native code regions of the JIT\n");
+	fprintf(stderr, "                     compiler to /tmp/perf-<pid>.map (named by\n");
+	fprintf(stderr, "                     the source offsets of the loops)\n");
+	fprintf(stderr, "  --jitdump          Write the native code of the JIT compiler\n");
+	fprintf(stderr, "                     to /tmp/jit-<pid>.dump (for perf inject)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	igd_socket_default(addr.sun_path, sizeof(addr.sun_path));
+	
+	int arg = 1;
+	
+	while (arg < argc) {
+		if (strncmp(argv[arg], "--socket=", 9) == 0) {
+			if (strlen(argv[arg] + 9) >= sizeof(addr.sun_path)) {
+				fprintf(stderr, "%s: Path too long\n", argv[arg]);
+				return 1;
+			}
+			
+			strcpy(addr.sun_path, argv[arg] + 9);
+		} else if (strncmp(argv[arg], "--cache=", 8) == 0) {
+			char *end;
+			long limit = strtol(argv[arg] + 8, &end, 10);
+			if ((limit <= 0) || (*end != 0)) {
+				fprintf(stderr, "%s: Invalid cache size\n", argv[arg]);
+				usage(argv[0]);
+				return 1;
+			}
+			
+			cache_limit = limit;
+		} else if (strcmp(argv[arg], "--engine=switch") == 0)
+			engine = ICHIGLYPH_ENGINE_SWITCH;
+		else if (strcmp(argv[arg], "--engine=threaded") == 0)
+			engine = ICHIGLYPH_ENGINE_THREADED;
+		else if (strcmp(argv[arg], "--engine=jit") == 0)
+			engine = ICHIGLYPH_ENGINE_JIT;
+		else if (strcmp(argv[arg], "--engine=tiered") == 0)
+			engine = ICHIGLYPH_ENGINE_TIERED;
+		else if (strcmp(argv[arg], "--tape=virtual") == 0)
+			tape = ICHIGLYPH_TAPE_VIRTUAL;
+		else if (strcmp(argv[arg], "--tape=dynamic") == 0)
+			tape = ICHIGLYPH_TAPE_DYNAMIC;
+		else if (strcmp(argv[arg], "--perf-map") == 0)
+			perf |= ICHIGLYPH_PERF_MAP;
+		else if (strcmp(argv[arg], "--jitdump") == 0)
+			perf |= ICHIGLYPH_PERF_JITDUMP;
+		else {
+			fprintf(stderr, "%s: Unknown option\n", argv[arg]);
+			usage(argv[0]);
+			return 1;
+		}
+		
+		arg++;
+	}
+	
+	/*
+	 * The clients may disconnect at any time.
+	 */
+	signal(SIGPIPE, SIG_IGN);
+	
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0) {
+		fprintf(stderr, "%s: Unable to create socket\n", addr.sun_path);
+		return 2;
+	}
+	
+	/*
+	 * A stale socket of a previous daemon is replaced. The socket
+	 * is accessible only by the owner.
+	 */
+	(void) unlink(addr.sun_path);
+	mode_t mask = umask(077);
+	int ret = bind(listener, (struct sockaddr *) &addr, sizeof(addr));
+	umask(mask);
+	
+	if ((ret != 0) || (listen(listener, SOMAXCONN) != 0)) {
+		fprintf(stderr, "%s: Unable to listen\n", addr.sun_path);
+		close(listener);
+		return 2;
+	}
+	
+	while (true) {
+		int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+		if (sock < 0) {
+			if ((errno == EMFILE) || (errno == ENFILE)) {
+				/* Wait for some connections to be closed */
+				usleep(10000);
+				continue;
+			}
+			
+			if ((errno == EINTR) || (errno == ECONNABORTED))
+				continue;
+			
+			break;
+		}
+		
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		
+		pthread_t thread;
+		if (pthread_create(&thread, &attr, connection_serve,
+		    (void *) (intptr_t) sock) != 0)
+			close(sock);
+		
+		pthread_attr_destroy(&attr);
+	}
+	
+	fprintf(stderr, "%s: Unable to accept\n", addr.sun_path);
+	close(listener);
+	unlink(addr.sun_path);
+	return 2;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is the protocol between the Ichiglyph daemon and its
+ * clients. The client connects to the Unix domain socket of the
+ * daemon and sends a request together with its standard input
+ * and standard output file descriptors (as SCM_RIGHTS ancillary
+ * data). The daemon executes the program using the passed file
+ * descriptors directly and replies with the response once the
+ * execution terminates. Multiple requests can be sent over the
+ * same connection.
+ *
+ * The program is identified either by its path (followed by the
+ * request) or by its hash. The hash is the 64-bit FNV-1a hash
+ * of the language byte followed by the program source. The
+ * daemon keeps the recently used compiled programs in a cache
+ * keyed by the hash, thus the program identified by its hash
+ * needs to be in the cache already.
+ *
+ */
+
+#ifndef IGD_PROTOCOL_H_
+#define IGD_PROTOCOL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/** Magic number of the requests */
+#define IGD_MAGIC  UINT32_C(0x49474431)
+
+/** Maximal size of the path of the program */
+#define IGD_PATH_MAX  4096
+
+/** Exit code of an unknown program hash */
+#define IGD_UNKNOWN  8
+
+/** FNV-1a offset basis */
+#define IGD_HASH_BASIS  UINT64_C(0xcbf29ce484222325)
+
+/** FNV-1a prime */
+#define IGD_HASH_PRIME  UINT64_C(0x100000001b3)
+
+/** Request */
+typedef struct {
+	uint32_t magic;      /**< IGD_MAGIC */
+	uint8_t language;    /**< Language of the program
+	                          (ichiglyph_language_t) */
+	uint8_t by_hash;     /**< Whether the program is identified by
+	                          its hash */
+	uint16_t path_size;  /**< Size of the path of the program
+	                          following the request */
+	uint64_t hash;       /**< Hash of the program */
+	uint64_t budget;     /**< Budget of the execution (0 for no
+	                          limit) */
+} igd_request_t;
+
+/** Response */
+typedef struct {
+	int32_t status;      /**< Exit code of the execution (the same as
+	                          the exit code of the interpreter) */
+	uint32_t unmatched_valid;  /**< Whether the compilation failed
+	                                due to an unmatched bracket */
+	uint64_t hash;       /**< Hash of the program */
+	uint64_t unmatched;  /**< Position of the unmatched bracket */
+} igd_response_t;
+
+/** Get the default path of the socket
+ *
+ * @param path Buffer for the path.
+ * @param size Size of the buffer.
+ *
+ */
+static inline void igd_socket_default(char *path, size_t size)
+{
+	snprintf(path, size, "/tmp/ichiglyph-%u.sock", (unsigned) getuid());
+}
+
+/** Hash a program
+ *
+ * @param hash  Hash of the preceding bytes (IGD_HASH_BASIS
+ *              initially).
+ * @param bytes Bytes to hash.
+ * @param count Number of the bytes.
+ *
+ * @return Hash of the preceding bytes and the bytes.
+ *
+ */
+static inline uint64_t igd_hash(uint64_t hash, const uint8_t *bytes,
+    size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		hash ^= bytes[i];
+		hash *= IGD_HASH_PRIME;
+	}
+	
+	return hash;
+}
+
+#endif
@@ -0,0 +1,1260 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is the frontend shared by the Ichiglyph and Brainfuck
+ * interpreters. It parses the command-line options, maps the
+ * source file and the standard input, runs the batches of inputs
+ * and prints the statistics, the counters and the profiles. The
+ * interpreters differ only in the language of the source file.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <ichiglyph.h>
+#include "frontend.h"
+
+/** Minimal number of bytes copied by the kernel */
+#define COPY_THRESHOLD  65536
+
+/** Number of the hot loops in the profile report */
+#define PROFILE_TOP  10
+
+/** Number of the system calls transferring the input and output */
+static uint64_t syscalls = 0;
+
+/** Standard input mapped into the memory */
+typedef struct {
+	/** Mapped bytes (NULL if the input is not mapped) */
+	const uint8_t *data;
+
+	/** Size of the mapping */
+	size_t size;
+
+	/** Offset of the input in the mapping */
+	size_t offset;
+
+	/** Whether the standard output is a regular file (thus the
+	    mapped input can be copied to it by copy_file_range(2)) */
+	bool output_regular;
+} input_map_t;
+
+/** Input of a batch */
+typedef struct {
+	/** Name of the input (for messages) */
+	char *name;
+
+	/** Name of the output file (part of the name of the input) */
+	const char *file;
+
+	/** Input bytes */
+	const uint8_t *data;
+
+	/** Number of the input bytes */
+	size_t size;
+
+	/** Whether the input bytes are a mapped input file */
+	bool mapped;
+
+	/** Output bytes collected in the memory */
+	uint8_t *output;
+
+	/** Number of the output bytes */
+	size_t output_size;
+
+	/** Size of the memory for the output bytes */
+	size_t output_capacity;
+
+	/** Whether the output bytes could not be collected */
+	bool output_failed;
+
+	/** Exit code of the execution */
+	int status;
+
+	/** Whether the execution has finished */
+	bool done;
+} batch_input_t;
+
+/** Batch of inputs */
+typedef struct {
+	/** Compiled program shared by all workers */
+	ichiglyph_program_t *program;
+
+	/** Execution engine */
+	ichiglyph_engine_t engine;
+
+	/** Whether the inputs are executed in lockstep */
+	bool lockstep;
+
+	/** Data memory mode */
+	ichiglyph_tape_t tape;
+
+	/** Perf output of the native code (ichiglyph_perf_t flags) */
+	unsigned int perf;
+
+	/** Budget of each execution (0 for no limit) */
+	uint64_t budget;
+
+	/** Number of the compiled instructions executed by all inputs */
+	uint64_t executed;
+
+	/** Directory for the output files (-1 for the standard output) */
+	int output_dir;
+
+	/** Inputs */
+	batch_input_t *inputs;
+
+	/** Number of the inputs */
+	size_t count;
+
+	/** Mapped batch file (NULL if the inputs are files) */
+	void *lines;
+
+	/** Size of the mapped batch file */
+	size_t lines_size;
+
+	/** Next input to be executed */
+	size_t next;
+
+	/** Lock protecting the completion of the inputs */
+	pthread_mutex_t lock;
+
+	/** Signalled when an input has been completed */
+	pthread_cond_t completed;
+} batch_t;
+
+/** Read the standard input
+ *
+ * @param arg   Unused.
+ * @param bytes Buffer for the input bytes.
+ * @param count Size of the buffer.
+ *
+ * @return Number of bytes read, 0 on the end of the input or
+ *         negative value on an error.
+ *
+ */
+static ssize_t input_read(void *arg, uint8_t *bytes, size_t count)
+{
+	while (true) {
+		ssize_t ret = read(STDIN_FILENO, bytes, count);
+		__atomic_fetch_add(&syscalls, 1, __ATOMIC_RELAXED);
+		if ((ret < 0) && (errno == EINTR))
+			continue;
+		
+		return ret;
+	}
+}
+
+/** Write bytes to a file descriptor
+ *
+ * @param fd    File descriptor.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+static void fd_write(int fd, const uint8_t *bytes, size_t count)
+{
+	size_t pos = 0;
+	
+	while (pos < count) {
+		ssize_t ret = write(fd, bytes + pos, count - pos);
+		__atomic_fetch_add(&syscalls, 1, __ATOMIC_RELAXED);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			
+			break;
+		}
+		
+		pos += ret;
+	}
+}
+
+/** Write the standard output
+ *
+ * Long runs of the bytes of the mapped standard input are copied
+ * by the kernel (using copy_file_range(2) or sendfile(2)) without
+ * passing through the user space.
+ *
+ * @param arg   Mapped standard input.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+static void output_write(void *arg, const uint8_t *bytes, size_t count)
+{
+	input_map_t *map = (input_map_t *) arg;
+	
+	if ((map->data != NULL) && (count >= COPY_THRESHOLD) &&
+	    (bytes >= map->data) && (bytes + count <= map->data + map->size)) {
+		off_t offset = bytes - map->data;
+		
+		while (count > 0) {
+			ssize_t ret = -1;
+			
+			if (map->output_regular) {
+				ret = copy_file_range(STDIN_FILENO, &offset, STDOUT_FILENO,
+				    NULL, count, 0);
+				__atomic_fetch_add(&syscalls, 1, __ATOMIC_RELAXED);
+				if (ret < 0)
+					map->output_regular = false;
+			}
+			
+			if (ret < 0) {
+				ret = sendfile(STDOUT_FILENO, STDIN_FILENO, &offset, count);
+				__atomic_fetch_add(&syscalls, 1, __ATOMIC_RELAXED);
+			}
+			
+			if (ret <= 0)
+				break;
+			
+			count -= ret;
+		}
+		
+		bytes = map->data + offset;
+	}
+	
+	fd_write(STDOUT_FILENO, bytes, count);
+}
+
+/** Map the standard input
+ *
+ * If the standard input is a regular file, it is mapped into
+ * the memory and consumed directly from the mapping starting
+ * at the current file offset.
+ *
+ * @param map Mapped standard input.
+ *
+ * @return True if the standard input has been mapped.
+ *
+ */
+static bool input_map(input_map_t *map)
+{
+	struct stat st;
+	
+	map->data = NULL;
+	map->size = 0;
+	map->offset = 0;
+	map->output_regular = ((fstat(STDOUT_FILENO, &st) == 0) &&
+	    (S_ISREG(st.st_mode)));
+	
+	if ((fstat(STDIN_FILENO, &st) != 0) || (!S_ISREG(st.st_mode)))
+		return false;
+	
+	off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+	if ((offset < 0) || (offset >= st.st_size) ||
+	    ((uintmax_t) st.st_size > SIZE_MAX))
+		return false;
+	
+	void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+	    STDIN_FILENO, 0);
+	if (mapped == MAP_FAILED)
+		return false;
+	
+	(void) madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+	
+	map->data = (const uint8_t *) mapped;
+	map->size = st.st_size;
+	map->offset = offset;
+	return true;
+}
+
+/** Unmap the standard input
+ *
+ * The offset of the standard input is left right after the
+ * last input byte consumed from the mapping.
+ *
+ * @param map      Mapped standard input.
+ * @param consumed Number of the consumed input bytes.
+ *
+ */
+static void input_unmap(input_map_t *map, size_t consumed)
+{
+	if (map->data == NULL)
+		return;
+	
+	if (consumed > 0)
+		(void) lseek(STDIN_FILENO, map->offset + consumed, SEEK_SET);
+	
+	munmap((void *) map->data, map->size);
+	map->data = NULL;
+}
+
+/** Add an input to the batch
+ *
+ * @param batch  Batch of inputs.
+ * @param name   Name of the input (taken over by the batch).
+ * @param file   Name of the output file (part of the name).
+ * @param data   Input bytes.
+ * @param size   Number of the input bytes.
+ * @param mapped Whether the input bytes are a mapped input file.
+ *
+ * @return True if the input has been added.
+ *
+ */
+static bool batch_add(batch_t *batch, char *name, const char *file,
+    const uint8_t *data, size_t size, bool mapped)
+{
+	/*
+	 * The array of the inputs grows exponentially.
+	 */
+	if ((batch->count & (batch->count - 1)) == 0) {
+		size_t capacity = (batch->count > 0) ? batch->count * 2 : 1;
+		batch_input_t *inputs = (batch_input_t *) realloc(batch->inputs,
+		    capacity * sizeof(batch_input_t));
+		if (inputs == NULL)
+			return false;
+		
+		batch->inputs = inputs;
+	}
+	
+	batch_input_t *input = &batch->inputs[batch->count];
+	memset(input, 0, sizeof(batch_input_t));
+	input->name = name;
+	input->file = file;
+	input->data = data;
+	input->size = size;
+	input->mapped = mapped;
+	
+	batch->count++;
+	return true;
+}
+
+/** Compare the names of two inputs
+ *
+ * @param a First input.
+ * @param b Second input.
+ *
+ * @return Result of strcmp(3) on the names.
+ *
+ */
+static int batch_compare(const void *a, const void *b)
+{
+	return strcmp(((const batch_input_t *) a)->name,
+	    ((const batch_input_t *) b)->name);
+}
+
+/** Load the inputs of a batch from a directory
+ *
+ * Each regular file in the directory (except for hidden files)
+ * is an input. The inputs are ordered by their names.
+ *
+ * @param batch Batch of inputs.
+ * @param path  Path of the directory.
+ *
+ * @return True if the inputs have been loaded.
+ *
+ */
+static bool batch_load_directory(batch_t *batch, const char *path)
+{
+	DIR *dir = opendir(path);
+	if (dir == NULL)
+		return false;
+	
+	size_t prefix = strlen(path) + 1;
+	struct dirent *entry;
+	
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		
+		int fd = openat(dirfd(dir), entry->d_name, O_RDONLY);
+		if (fd < 0)
+			continue;
+		
+		struct stat st;
+		if ((fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode))) {
+			close(fd);
+			continue;
+		}
+		
+		void *data = NULL;
+		if (st.st_size > 0) {
+			data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (data == MAP_FAILED) {
+				close(fd);
+				closedir(dir);
+				return false;
+			}
+		}
+		
+		close(fd);
+		
+		char *name;
+		if ((asprintf(&name, "%s/%s", path, entry->d_name) < 0) ||
+		    (!batch_add(batch, name, name + prefix, (const uint8_t *) data,
+		    st.st_size, true))) {
+			if (data != NULL)
+				munmap(data, st.st_size);
+			
+			closedir(dir);
+			return false;
+		}
+	}
+	
+	closedir(dir);
+	
+	qsort(batch->inputs, batch->count, sizeof(batch_input_t),
+	    batch_compare);
+	
+	/*
+	 * The names of the output files need to be fixed after
+	 * sorting (they point into the names of the inputs).
+	 */
+	for (size_t i = 0; i < batch->count; i++)
+		batch->inputs[i].file = batch->inputs[i].name + prefix;
+	
+	return true;
+}
+
+/** Load the inputs of a batch from a file
+ *
+ * Each line of the file (including the line terminator) is an
+ * input. The output files are named after the line numbers.
+ *
+ * @param batch Batch of inputs.
+ * @param path  Path of the file.
+ * @param fd    Open file.
+ * @param size  Size of the file.
+ *
+ * @return True if the inputs have been loaded.
+ *
+ */
+static bool batch_load_lines(batch_t *batch, const char *path, int fd,
+    size_t size)
+{
+	if (size == 0)
+		return true;
+	
+	void *lines = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (lines == MAP_FAILED)
+		return false;
+	
+	batch->lines = lines;
+	batch->lines_size = size;
+	
+	const uint8_t *data = (const uint8_t *) lines;
+	size_t pos = 0;
+	
+	while (pos < size) {
+		const uint8_t *eol = (const uint8_t *) memchr(data + pos, '\n',
+		    size - pos);
+		size_t end = (eol != NULL) ? (size_t) (eol - data) + 1 : size;
+		
+		char *name;
+		if (asprintf(&name, "%s:%zu", path, batch->count + 1) < 0)
+			return false;
+		
+		if (!batch_add(batch, name, strrchr(name, ':') + 1, data + pos,
+		    end - pos, false)) {
+			free(name);
+			return false;
+		}
+		
+		pos = end;
+	}
+	
+	return true;
+}
+
+/** Load the inputs of a batch
+ *
+ * @param batch Batch of inputs.
+ * @param path  Path of the directory of the inputs or of the
+ *              file with the input lines.
+ *
+ * @return True if the inputs have been loaded.
+ *
+ */
+static bool batch_load(batch_t *batch, const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	
+	bool ret;
+	if (S_ISDIR(st.st_mode))
+		ret = batch_load_directory(batch, path);
+	else
+		ret = batch_load_lines(batch, path, fd, st.st_size);
+	
+	close(fd);
+	return ret;
+}
+
+/** Release the inputs of a batch
+ *
+ * @param batch Batch of inputs.
+ *
+ */
+static void batch_release(batch_t *batch)
+{
+	for (size_t i = 0; i < batch->count; i++) {
+		batch_input_t *input = &batch->inputs[i];
+		
+		if ((input->mapped) && (input->data != NULL))
+			munmap((void *) input->data, input->size);
+		
+		free(input->output);
+		free(input->name);
+	}
+	
+	if (batch->lines != NULL)
+		munmap(batch->lines, batch->lines_size);
+	
+	free(batch->inputs);
+}
+
+/** Collect the output of an input in the memory
+ *
+ * @param arg   Input of the batch.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+static void batch_collect(void *arg, const uint8_t *bytes, size_t count)
+{
+	batch_input_t *input = (batch_input_t *) arg;
+	
+	if (input->output_failed)
+		return;
+	
+	if (input->output_size + count > input->output_capacity) {
+		size_t capacity = (input->output_capacity > 0) ?
+		    input->output_capacity : 4096;
+		while (capacity < input->output_size + count)
+			capacity *= 2;
+		
+		uint8_t *output = (uint8_t *) realloc(input->output, capacity);
+		if (output == NULL) {
+			input->output_failed = true;
+			return;
+		}
+		
+		input->output = output;
+		input->output_capacity = capacity;
+	}
+	
+	memcpy(input->output + input->output_size, bytes, count);
+	input->output_size += count;
+}
+
+/** Write bytes to an output file
+ *
+ * @param arg   Output file descriptor.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+static void file_write(void *arg, const uint8_t *bytes, size_t count)
+{
+	fd_write(*((int *) arg), bytes, count);
+}
+
+/** Execute an input of a batch
+ *
+ * @param vm    Virtual machine.
+ * @param batch Batch of inputs.
+ * @param lane  Input and output of the execution.
+ *
+ */
+static void batch_run(ichiglyph_vm_t *vm, batch_t *batch,
+    ichiglyph_lane_t *lane)
+{
+	ichiglyph_vm_set_input_memory(vm, lane->input, lane->input_size);
+	ichiglyph_vm_set_output(vm, lane->write, lane->write_arg,
+	    ICHIGLYPH_BUFFER_FULL);
+	lane->result = ichiglyph_vm_run(vm, batch->program, batch->budget);
+	lane->executed = ichiglyph_vm_executed(vm);
+}
+
+/** Execute the inputs of a batch
+ *
+ * Each worker executes the inputs in its own virtual machine
+ * (i.e. with its own data memory) while the compiled program
+ * is shared. In the lockstep mode, each worker takes as many
+ * inputs at once as there are lanes.
+ *
+ * @param arg Batch of inputs.
+ *
+ * @return NULL.
+ *
+ */
+static void *batch_worker(void *arg)
+{
+	batch_t *batch = (batch_t *) arg;
+	ichiglyph_vm_t *vm = ichiglyph_vm_create(batch->engine, batch->tape);
+	if (vm != NULL)
+		ichiglyph_vm_set_perf(vm, batch->perf);
+	
+	size_t step = (batch->lockstep) ? ICHIGLYPH_LANES : 1;
+	
+	while (true) {
+		size_t first = __atomic_fetch_add(&batch->next, step,
+		    __ATOMIC_RELAXED);
+		if (first >= batch->count)
+			break;
+		
+		size_t count = batch->count - first;
+		if (count > step)
+			count = step;
+		
+		ichiglyph_lane_t lanes[ICHIGLYPH_LANES];
+		int fds[ICHIGLYPH_LANES];
+		
+		for (size_t i = 0; i < count; i++) {
+			batch_input_t *input = &batch->inputs[first + i];
+			
+			lanes[i].input = input->data;
+			lanes[i].input_size = input->size;
+			lanes[i].write = batch_collect;
+			lanes[i].write_arg = input;
+			lanes[i].result = ICHIGLYPH_OUT_OF_MEMORY;
+			lanes[i].executed = 0;
+			fds[i] = -1;
+			
+			if (batch->output_dir >= 0) {
+				fds[i] = openat(batch->output_dir, input->file,
+				    O_WRONLY | O_CREAT | O_TRUNC, 0666);
+				if (fds[i] < 0)
+					input->status = 2;
+				
+				lanes[i].write = (fds[i] >= 0) ? file_write : NULL;
+				lanes[i].write_arg = &fds[i];
+			}
+		}
+		
+		/*
+		 * The program executed from the start (if the budget does
+		 * not cover its beginning evaluated in advance) might not
+		 * be executable in lockstep, thus the lanes fall back to
+		 * separate executions.
+		 */
+		if ((vm != NULL) && ((!batch->lockstep) ||
+		    (ichiglyph_vm_run_lockstep(vm, batch->program, lanes, count,
+		    batch->budget) == ICHIGLYPH_UNSUPPORTED))) {
+			for (size_t i = 0; i < count; i++)
+				batch_run(vm, batch, &lanes[i]);
+		}
+		
+		for (size_t i = 0; i < count; i++) {
+			batch_input_t *input = &batch->inputs[first + i];
+			
+			if (fds[i] >= 0)
+				close(fds[i]);
+			
+			__atomic_fetch_add(&batch->executed, lanes[i].executed,
+			    __ATOMIC_RELAXED);
+			
+			if (input->status == 0) {
+				if ((lanes[i].result == ICHIGLYPH_OUT_OF_MEMORY) ||
+				    (input->output_failed))
+					input->status = 6;
+				else if (lanes[i].result == ICHIGLYPH_BUDGET)
+					input->status = 7;
+			}
+			
+			pthread_mutex_lock(&batch->lock);
+			input->done = true;
+			pthread_cond_signal(&batch->completed);
+			pthread_mutex_unlock(&batch->lock);
+		}
+	}
+	
+	if (vm != NULL)
+		ichiglyph_vm_destroy(vm);
+	
+	return NULL;
+}
+
+/** Execute a batch
+ *
+ * The inputs are executed by a pool of worker threads. The
+ * outputs are written either to the standard output in the
+ * order of the inputs, or to the output files as soon as they
+ * are produced.
+ *
+ * @param batch   Batch of inputs.
+ * @param threads Number of the worker threads.
+ *
+ * @return Exit code of the first failed input or 0.
+ *
+ */
+static int batch_execute(batch_t *batch, size_t threads)
+{
+	if (threads > batch->count)
+		threads = batch->count;
+	
+	pthread_t *workers = (pthread_t *) malloc(threads * sizeof(pthread_t));
+	size_t started = 0;
+	
+	if (workers != NULL) {
+		while ((started < threads) &&
+		    (pthread_create(&workers[started], NULL, batch_worker,
+		    batch) == 0))
+			started++;
+	}
+	
+	/*
+	 * If no worker thread can be started, the inputs are
+	 * executed by the main thread.
+	 */
+	if ((started == 0) && (batch->count > 0))
+		(void) batch_worker(batch);
+	
+	int ret = 0;
+	
+	for (size_t i = 0; i < batch->count; i++) {
+		batch_input_t *input = &batch->inputs[i];
+		
+		pthread_mutex_lock(&batch->lock);
+		while (!input->done)
+			pthread_cond_wait(&batch->completed, &batch->lock);
+		pthread_mutex_unlock(&batch->lock);
+		
+		if (input->output != NULL) {
+			fd_write(STDOUT_FILENO, input->output, input->output_size);
+			free(input->output);
+			input->output = NULL;
+		}
+		
+		switch (input->status) {
+		case 2:
+			fprintf(stderr, "%s: Unable to create output\n", input->name);
+			break;
+		case 6:
+			fprintf(stderr, "%s: Out of memory\n", input->name);
+			break;
+		case 7:
+			fprintf(stderr, "%s: Budget exhausted\n", input->name);
+			break;
+		}
+		
+		if (ret == 0)
+			ret = input->status;
+	}
+	
+	for (size_t i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	
+	free(workers);
+	return ret;
+}
+
+/** Write the execution profile
+ *
+ * The hot loops are written to the standard error output and
+ * optionally the complete profile is written to a file in the
+ * callgrind format.
+ *
+ * @param vm             Virtual machine.
+ * @param program        Compiled program.
+ * @param source         Program source.
+ * @param size           Size of the program source.
+ * @param name           Name of the program source.
+ * @param callgrind_name Name of the callgrind file (NULL if none).
+ *
+ * @return True if the profile has been written.
+ *
+ */
+static bool profile_write(ichiglyph_vm_t *vm, ichiglyph_program_t *program,
+    const void *source, size_t size, const char *name,
+    const char *callgrind_name)
+{
+	int fd = STDERR_FILENO;
+	ichiglyph_result_t result = ichiglyph_vm_profile(vm, program, source,
+	    size, name, ICHIGLYPH_PROFILE_TEXT, PROFILE_TOP, file_write, &fd);
+	if (result != ICHIGLYPH_OK) {
+		fprintf(stderr, "%s: Unable to write the profile\n", name);
+		return false;
+	}
+	
+	if (callgrind_name == NULL)
+		return true;
+	
+	fd = open(callgrind_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "%s: Unable to create\n", callgrind_name);
+		return false;
+	}
+	
+	result = ichiglyph_vm_profile(vm, program, source, size, name,
+	    ICHIGLYPH_PROFILE_CALLGRIND, 0, file_write, &fd);
+	close(fd);
+	
+	if (result != ICHIGLYPH_OK) {
+		fprintf(stderr, "%s: Unable to write the profile\n", callgrind_name);
+		return false;
+	}
+	
+	return true;
+}
+
+/** Print the execution statistics
+ *
+ * The statistics consist of the wall-clock time since the start,
+ * the number of the executed compiled instructions (counted only
+ * if the budget is limited), the number of the system calls
+ * transferring the input and output and the peak resident set
+ * size.
+ *
+ * @param name     Name of the source file.
+ * @param start    Start of the execution.
+ * @param executed Number of the executed compiled instructions.
+ *
+ */
+static void stats_print(const char *name, const struct timespec *start,
+    uint64_t executed)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	double elapsed = (double) (now.tv_sec - start->tv_sec) +
+	    (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+	
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		usage.ru_maxrss = 0;
+	
+	fprintf(stderr, "%s: %.6f s, %" PRIu64 " instructions, %" PRIu64
+	    " syscalls, %ld KiB peak RSS\n", name, elapsed, executed,
+	    __atomic_load_n(&syscalls, __ATOMIC_RELAXED), usage.ru_maxrss);
+}
+
+/** Print the execution counters
+ *
+ * @param name Name of the source file.
+ * @param vm   Virtual machine.
+ *
+ */
+static void counters_print(const char *name, ichiglyph_vm_t *vm)
+{
+	ichiglyph_counters_t counters;
+	ichiglyph_vm_counters(vm, &counters);
+	
+	fprintf(stderr, "%s: %" PRIu64 " instructions, %" PRIu64
+	    " tape span, %" PRIu64 " input calls, %" PRIu64
+	    " output calls\n", name, counters.instructions, counters.span,
+	    counters.input, counters.output);
+}
+
+/** Print usage
+ *
+ * @param name Name of the executable.
+ *
+ */
+static void usage(const char *name)
+{
+	fprintf(stderr, "Syntax: %s [<options>] <source>\n", name);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --engine=switch    Use the switch-based engine\n");
+	fprintf(stderr, "  --engine=threaded  Use the direct-threaded engine (default)\n");
+	fprintf(stderr, "  --engine=jit       Use the x86-64 JIT compiler (falls back to\n");
+	fprintf(stderr, "                     the direct-threaded engine if unavailable)\n");
+	fprintf(stderr, "  --jit              Same as --engine=jit\n");
+	fprintf(stderr, "  --engine=tiered    Use the direct-threaded engine and compile\n");
+	fprintf(stderr, "                     the hot loops using the x86-64 JIT compiler\n");
+	fprintf(stderr, "  --engine=lockstep  Execute the inputs of the batch in lockstep\n");
+	fprintf(stderr, "                     using vector operations (falls back to the\n");
+	fprintf(stderr, "                     direct-threaded engine if the program moves\n");
+	fprintf(stderr, "                     the data pointer in loops)\n");
+	fprintf(stderr, "  --tape=virtual     Reserve virtual data memory with guard areas\n");
+	fprintf(stderr, "                     (default, falls back to the dynamic data\n");
+	fprintf(stderr, "                     memory if unavailable)\n");
+	fprintf(stderr, "  --tape=dynamic     Resize the data memory on demand\n");
+	fprintf(stderr, "  --unbuffered       Write every output byte immediately (the output\n");
+	fprintf(stderr, "                     is line buffered on a terminal and fully\n");
+	fprintf(stderr, "                     buffered otherwise by default)\n");
+	fprintf(stderr, "  --no-fold          Do not evaluate the beginning of the program\n");
+	fprintf(stderr, "                     that does not depend on the input in advance\n");
+	fprintf(stderr, "  --budget=<n>       Stop after executing about <n> compiled\n");
+	fprintf(stderr, "                     instructions\n");
+	fprintf(stderr, "  --stats            Print the wall-clock time, the number of\n");
+	fprintf(stderr, "                     the executed instructions (if the budget\n");
+	fprintf(stderr, "                     is limited), the number of the input and\n");
+	fprintf(stderr, "                     output system calls and the peak RSS\n");
+	fprintf(stderr, "  --counters         Print the number of the dispatched\n");
+	fprintf(stderr, "                     instructions, the span of the addressed\n");
+	fprintf(stderr, "                     tape cells (from the lowest to the highest\n");
+	fprintf(stderr, "                     one) and the number of the input and output\n");
+	fprintf(stderr, "                     calls (deterministic, the same for all\n");
+	fprintf(stderr, "                     engines)\n");
+	fprintf(stderr, "  --perf-map         Write the native code regions of the JIT\n");
+	fprintf(stderr, "                     compiler to /tmp/perf-<pid>.map (named by\n");
+	fprintf(stderr, "                     the source offsets of the loops)\n");
+	fprintf(stderr, "  --jitdump          Write the native code of the JIT compiler\n");
+	fprintf(stderr, "                     to /tmp/jit-<pid>.dump (for perf inject)\n");
+	fprintf(stderr, "  --profile          Count the executions of the instructions\n");
+	fprintf(stderr, "                     and the trip counts of the loops and print\n");
+	fprintf(stderr, "                     the hot loops (implies --no-fold)\n");
+	fprintf(stderr, "  --callgrind=<file> Same as --profile and write the complete\n");
+	fprintf(stderr, "                     profile to the file in the callgrind format\n");
+	fprintf(stderr, "  --batch=<path>     Execute the program on each file in the\n");
+	fprintf(stderr, "                     directory (or on each line of the file)\n");
+	fprintf(stderr, "                     as a separate input\n");
+	fprintf(stderr, "  --threads=<n>      Number of the worker threads of the batch\n");
+	fprintf(stderr, "                     (default is the number of processors)\n");
+	fprintf(stderr, "  --output=<dir>     Write the output of each input of the batch\n");
+	fprintf(stderr, "                     to a separate file in the directory (the\n");
+	fprintf(stderr, "                     outputs are written to the standard output\n");
+	fprintf(stderr, "                     in the order of the inputs by default)\n");
+}
+
+/** Run the interpreter
+ *
+ * Parse the command-line options, compile the source file in the
+ * given language and execute it on the standard input (or on the
+ * inputs of the batch).
+ *
+ * @param argc     Number of the command-line arguments.
+ * @param argv     Command-line arguments.
+ * @param language Language of the source file.
+ *
+ * @return Exit code of the interpreter.
+ *
+ */
+int frontend_main(int argc, char *argv[], ichiglyph_language_t language)
+{
+	/*
+	 * The command-line options are followed by the source file
+	 * in the given language.
+	 */
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	ichiglyph_engine_t engine = ICHIGLYPH_ENGINE_THREADED;
+	bool lockstep = false;
+	
+	/*
+	 * The interpreter does not handle SIGSEGV and SIGBUS itself,
+	 * thus it opts in to the virtual data memory by default.
+	 */
+	ichiglyph_tape_t tape = ICHIGLYPH_TAPE_VIRTUAL;
+	bool unbuffered = false;
+	bool fold = true;
+	uint64_t budget = 0;
+	bool stats = false;
+	bool counters = false;
+	unsigned int perf = ICHIGLYPH_PERF_NONE;
+	bool profile = false;
+	const char *callgrind_name = NULL;
+	const char *batch_name = NULL;
+	const char *output_name = NULL;
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int arg = 1;
+	
+	while ((arg < argc) && (strncmp(argv[arg], "--", 2) == 0)) {
+		if (strcmp(argv[arg], "--engine=switch") == 0) {
+			engine = ICHIGLYPH_ENGINE_SWITCH;
+			lockstep = false;
+		} else if (strcmp(argv[arg], "--engine=threaded") == 0) {
+			engine = ICHIGLYPH_ENGINE_THREADED;
+			lockstep = false;
+		} else if ((strcmp(argv[arg], "--engine=jit") == 0) ||
+		    (strcmp(argv[arg], "--jit") == 0)) {
+			engine = ICHIGLYPH_ENGINE_JIT;
+			lockstep = false;
+		} else if (strcmp(argv[arg], "--engine=tiered") == 0) {
+			engine = ICHIGLYPH_ENGINE_TIERED;
+			lockstep = false;
+		} else if (strcmp(argv[arg], "--engine=lockstep") == 0) {
+			engine = ICHIGLYPH_ENGINE_THREADED;
+			lockstep = true;
+		} else if (strcmp(argv[arg], "--tape=virtual") == 0)
+			tape = ICHIGLYPH_TAPE_VIRTUAL;
+		else if (strcmp(argv[arg], "--tape=dynamic") == 0)
+			tape = ICHIGLYPH_TAPE_DYNAMIC;
+		else if (strcmp(argv[arg], "--unbuffered") == 0)
+			unbuffered = true;
+		else if (strcmp(argv[arg], "--no-fold") == 0)
+			fold = false;
+		else if (strcmp(argv[arg], "--stats") == 0)
+			stats = true;
+		else if (strcmp(argv[arg], "--counters") == 0)
+			counters = true;
+		else if (strcmp(argv[arg], "--perf-map") == 0)
+			perf |= ICHIGLYPH_PERF_MAP;
+		else if (strcmp(argv[arg], "--jitdump") == 0)
+			perf |= ICHIGLYPH_PERF_JITDUMP;
+		else if (strcmp(argv[arg], "--profile") == 0)
+			profile = true;
+		else if (strncmp(argv[arg], "--callgrind=", 12) == 0) {
+			profile = true;
+			callgrind_name = argv[arg] + 12;
+		} else if (strncmp(argv[arg], "--budget=", 9) == 0) {
+			char *end;
+			budget = strtoull(argv[arg] + 9, &end, 10);
+			if ((budget == 0) || (*end != 0)) {
+				fprintf(stderr, "%s: Invalid budget\n", argv[arg]);
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (strncmp(argv[arg], "--batch=", 8) == 0)
+			batch_name = argv[arg] + 8;
+		else if (strncmp(argv[arg], "--output=", 9) == 0)
+			output_name = argv[arg] + 9;
+		else if (strncmp(argv[arg], "--threads=", 10) == 0) {
+			char *end;
+			threads = strtol(argv[arg] + 10, &end, 10);
+			if ((threads <= 0) || (*end != 0)) {
+				fprintf(stderr, "%s: Invalid number of threads\n", argv[arg]);
+				usage(argv[0]);
+				return 1;
+			}
+		} else {
+			fprintf(stderr, "%s: Unknown option\n", argv[arg]);
+			usage(argv[0]);
+			return 1;
+		}
+		
+		arg++;
+	}
+	
+	if (arg >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	
+	if ((profile) && (batch_name != NULL)) {
+		fprintf(stderr, "%s: Cannot profile a batch\n", batch_name);
+		usage(argv[0]);
+		return 1;
+	}
+	
+	if ((counters) && (batch_name != NULL)) {
+		fprintf(stderr, "%s: Cannot count a batch\n", batch_name);
+		usage(argv[0]);
+		return 1;
+	}
+	
+	/*
+	 * The profile covers the whole program, thus nothing
+	 * is evaluated in advance.
+	 */
+	if (profile) {
+		engine = ICHIGLYPH_ENGINE_PROFILE;
+		fold = false;
+	}
+	
+	char *source_name = argv[arg];
+	int source = open(source_name, O_RDONLY);
+	if (source < 0) {
+		fprintf(stderr, "%s: Unable to open\n", source_name);
+		return 2;
+	}
+	
+	struct stat stat;
+	int ret = fstat(source, &stat);
+	if (ret != 0) {
+		fprintf(stderr, "%s: Unable to stat\n", source_name);
+		close(source);
+		return 3;
+	}
+	
+	/*
+	 * We mmap the entire source file.
+	 */
+	size_t source_size = stat.st_size;
+	void *program = mmap(NULL, source_size, PROT_READ, MAP_PRIVATE,
+	    source, 0);
+	if (program == MAP_FAILED) {
+		fprintf(stderr, "%s: Unable to mmap\n", source_name);
+		close(source);
+		return 4;
+	}
+	
+	/*
+	 * Compile the program in advance, thus the instructions
+	 * do not need to be decoded during the execution.
+	 */
+	ichiglyph_program_t *compiled;
+	size_t unmatched;
+	ichiglyph_result_t result = ichiglyph_program_compile(
+	    language, program, source_size, fold,
+	    &compiled, &unmatched);
+	
+	/*
+	 * The source is retained for the profile report.
+	 */
+	if ((!profile) || (result != ICHIGLYPH_OK)) {
+		munmap(program, source_size);
+		close(source);
+	}
+	
+	if (result != ICHIGLYPH_OK) {
+		if (result == ICHIGLYPH_UNMATCHED)
+			fprintf(stderr, "%s: Unmatched bracket at instruction %zu\n",
+			    source_name, unmatched);
+		else
+			fprintf(stderr, "%s: Out of memory\n", source_name);
+		
+		return 5;
+	}
+	
+	if (batch_name != NULL) {
+		batch_t batch;
+		memset(&batch, 0, sizeof(batch));
+		batch.program = compiled;
+		batch.engine = engine;
+		batch.lockstep = ((lockstep) &&
+		    (ichiglyph_program_lockstep(compiled)));
+		
+		/*
+		 * The fallback is reported, thus the measurements are
+		 * not attributed to the lockstep engine.
+		 */
+		if ((lockstep) && (!batch.lockstep))
+			fprintf(stderr, "%s: Cannot execute in lockstep (using "
+			    "the direct-threaded engine)\n", source_name);
+		batch.tape = tape;
+		batch.perf = perf;
+		batch.budget = budget;
+		batch.output_dir = -1;
+		pthread_mutex_init(&batch.lock, NULL);
+		pthread_cond_init(&batch.completed, NULL);
+		
+		if (output_name != NULL) {
+			batch.output_dir = open(output_name, O_RDONLY | O_DIRECTORY);
+			if (batch.output_dir < 0) {
+				fprintf(stderr, "%s: Unable to open\n", output_name);
+				ichiglyph_program_destroy(compiled);
+				return 2;
+			}
+		}
+		
+		if (batch_load(&batch, batch_name))
+			ret = batch_execute(&batch, (threads > 0) ? threads : 1);
+		else {
+			fprintf(stderr, "%s: Unable to load\n", batch_name);
+			ret = 2;
+		}
+		
+		if (batch.output_dir >= 0)
+			close(batch.output_dir);
+		
+		if (stats)
+			stats_print(source_name, &start, batch.executed);
+		
+		batch_release(&batch);
+		pthread_cond_destroy(&batch.completed);
+		pthread_mutex_destroy(&batch.lock);
+		ichiglyph_program_destroy(compiled);
+		return ret;
+	}
+	
+	ichiglyph_vm_t *vm = ichiglyph_vm_create(engine, tape);
+	if (vm == NULL) {
+		fprintf(stderr, "%s: Out of memory\n", source_name);
+		ichiglyph_program_destroy(compiled);
+		return 6;
+	}
+	
+	ichiglyph_vm_set_perf(vm, perf);
+	ichiglyph_vm_set_counting(vm, counters);
+	
+	/*
+	 * The output is fully buffered by default. If the standard
+	 * output is a terminal, the output is line buffered, thus
+	 * the output of a long-running program appears in a timely
+	 * manner.
+	 */
+	ichiglyph_buffer_t buffer = ICHIGLYPH_BUFFER_FULL;
+	if (unbuffered)
+		buffer = ICHIGLYPH_BUFFER_NONE;
+	else if (isatty(STDOUT_FILENO))
+		buffer = ICHIGLYPH_BUFFER_LINE;
+	
+	input_map_t map;
+	if (input_map(&map))
+		ichiglyph_vm_set_input_memory(vm, map.data + map.offset,
+		    map.size - map.offset);
+	else
+		ichiglyph_vm_set_input(vm, input_read, NULL);
+	
+	ichiglyph_vm_set_output(vm, output_write, &map, buffer);
+	
+	result = ichiglyph_vm_run(vm, compiled, budget);
+	input_unmap(&map, ichiglyph_vm_consumed(vm));
+	
+	if (result == ICHIGLYPH_OUT_OF_MEMORY)
+		fprintf(stderr, "%s: Out of memory\n", source_name);
+	else if (result == ICHIGLYPH_BUDGET)
+		fprintf(stderr, "%s: Budget exhausted\n", source_name);
+	
+	if (counters)
+		counters_print(source_name, vm);
+	
+	if (stats)
+		stats_print(source_name, &start, ichiglyph_vm_executed(vm));
+	
+	bool profiled = true;
+	
+	if (profile) {
+		if (result != ICHIGLYPH_OUT_OF_MEMORY)
+			profiled = profile_write(vm, compiled, program, source_size,
+			    source_name, callgrind_name);
+		
+		munmap(program, source_size);
+		close(source);
+	}
+	
+	ichiglyph_vm_destroy(vm);
+	ichiglyph_program_destroy(compiled);
+	
+	if (result == ICHIGLYPH_OUT_OF_MEMORY)
+		return 6;
+	
+	if (result == ICHIGLYPH_BUDGET)
+		return 7;
+	
+	return profiled ? 0 : 2;
+}
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is the public interface of the Ichiglyph library. The library
+ * compiles Ichiglyph (or Brainfuck) programs and executes them in
+ * virtual machines, thus the programs can be run by other programs
+ * without spawning an interpreter process.
+ *
+ * A program is compiled once and it can be then executed any number
+ * of times (even concurrently) by any number of virtual machines.
+ * Each virtual machine has its own data memory and its own input
+ * and output supplied by the caller. A single virtual machine must
+ * not be used concurrently.
+ *
+ * A virtual machine can also execute a program on up to
+ * ICHIGLYPH_LANES inputs at once in lockstep. The data cells
+ * of all inputs are processed by vector operations and the
+ * divergent loops are handled by masking the lanes that have
+ * left the loop. Only the programs whose loops do not move the
+ * data pointer (when considered as a whole) can be executed
+ * in lockstep.
+ *
+ * The compiled instructions of a program can be also inspected
+ * (e.g. to translate the program into another language).
+ *
+ * The library does not install any signal handlers unless the
+ * virtual data memory (ICHIGLYPH_TAPE_VIRTUAL) is explicitly
+ * requested, see ichiglyph_tape_t.
+ *
+ */
+
+#ifndef ICHIGLYPH_H_
+#define ICHIGLYPH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of the inputs executed in lockstep */
+#define ICHIGLYPH_LANES  16
+
+/** Source languages */
+typedef enum {
+	ICHIGLYPH_LANGUAGE_ICHIGLYPH,  /**< Ichiglyph */
+	ICHIGLYPH_LANGUAGE_BRAINFUCK   /**< Brainfuck */
+} ichiglyph_language_t;
+
+/** Execution engines */
+typedef enum {
+	ICHIGLYPH_ENGINE_SWITCH,    /**< Switch-based dispatch */
+	ICHIGLYPH_ENGINE_THREADED,  /**< Direct-threaded dispatch */
+	ICHIGLYPH_ENGINE_JIT,       /**< Native code generated just-in-time
+	                                 (falls back to the direct-threaded
+	                                 dispatch if unavailable) */
+	ICHIGLYPH_ENGINE_PROFILE,   /**< Switch-based dispatch recording
+	                                 the execution profile */
+	ICHIGLYPH_ENGINE_TIERED     /**< Direct-threaded dispatch with
+	                                 the hot loops compiled to native
+	                                 code just-in-time (falls back to
+	                                 the direct-threaded dispatch if
+	                                 unavailable) */
+} ichiglyph_engine_t;
+
+/** Data memory modes
+ *
+ * WARNING: The virtual data memory installs process-wide SIGSEGV and
+ * SIGBUS handlers (once, when the first virtual data memory is
+ * reserved) to catch the accesses to the guard areas. The faults
+ * not caused by the guard areas are passed to the handlers installed
+ * before, but any handlers installed later by the application
+ * replace them. Therefore the virtual data memory is opt-in and
+ * it should be used only by applications that do not handle these
+ * signals themselves (such as the interpreters and the daemon).
+ *
+ */
+typedef enum {
+	ICHIGLYPH_TAPE_DYNAMIC,  /**< Data memory resized on demand
+	                              (default) */
+	ICHIGLYPH_TAPE_VIRTUAL   /**< Reserved virtual data memory with guard
+	                              areas, installing process-wide SIGSEGV
+	                              and SIGBUS handlers (falls back to the
+	                              dynamic data memory if unavailable) */
+} ichiglyph_tape_t;
+
+/** Output buffering modes */
+typedef enum {
+	ICHIGLYPH_BUFFER_FULL,  /**< Output written when the buffer is full */
+	ICHIGLYPH_BUFFER_LINE,  /**< Output written at the end of each line */
+	ICHIGLYPH_BUFFER_NONE   /**< Output written immediately */
+} ichiglyph_buffer_t;
+
+/** Perf output of the native code (flags) */
+typedef enum {
+	ICHIGLYPH_PERF_NONE = 0,    /**< No perf output */
+	ICHIGLYPH_PERF_MAP = 1,     /**< Perf map (/tmp/perf-<pid>.map) */
+	ICHIGLYPH_PERF_JITDUMP = 2  /**< Jitdump (/tmp/jit-<pid>.dump) */
+} ichiglyph_perf_t;
+
+/** Execution profile formats */
+typedef enum {
+	ICHIGLYPH_PROFILE_TEXT,      /**< Hot loops (human-readable) */
+	ICHIGLYPH_PROFILE_CALLGRIND  /**< Callgrind format (for KCachegrind) */
+} ichiglyph_profile_t;
+
+/** Results */
+typedef enum {
+	ICHIGLYPH_OK,             /**< Success */
+	ICHIGLYPH_BUDGET,         /**< Instruction budget exhausted */
+	ICHIGLYPH_UNMATCHED,      /**< Unmatched bracket in the program */
+	ICHIGLYPH_OUT_OF_MEMORY,  /**< Out-of-memory condition */
+	ICHIGLYPH_UNSUPPORTED     /**< Program cannot be executed
+	                               in lockstep */
+} ichiglyph_result_t;
+
+/** Operations of the compiled instructions */
+typedef enum {
+	ICHIGLYPH_OP_MOVE,    /**< Move the data pointer by the argument */
+	ICHIGLYPH_OP_ADD,     /**< Add the argument to the data cell at
+	                           the offset */
+	ICHIGLYPH_OP_SET,     /**< Set the data cell at the offset to
+	                           the argument */
+	ICHIGLYPH_OP_MUL,     /**< Add the data cell multiplied by the
+	                           argument to the data cell at the offset */
+	ICHIGLYPH_OP_SCAN,    /**< Move the data pointer by the argument
+	                           until a zero data cell is found */
+	ICHIGLYPH_OP_OUTPUT,  /**< Output the data cell at the offset */
+	ICHIGLYPH_OP_ACCEPT,  /**< Accept the data cell at the offset from
+	                           the input */
+	ICHIGLYPH_OP_CAT,     /**< Copy the input to the output while the
+	                           data cell is non-zero (the argument is
+	                           non-zero if the data cell is output
+	                           before it is accepted) */
+	ICHIGLYPH_OP_JZ,      /**< Jump to the target if the data cell
+	                           is zero */
+	ICHIGLYPH_OP_JNZ,     /**< Jump to the target if the data cell
+	                           is non-zero */
+	ICHIGLYPH_OP_HALT     /**< Terminate the execution */
+} ichiglyph_op_t;
+
+/** Compiled instruction */
+typedef struct {
+	ichiglyph_op_t op;  /**< Operation */
+	ssize_t arg;        /**< Argument of the operation */
+	ssize_t offset;     /**< Data cell offset relative to the data
+	                         pointer (or the position of the bracket
+	                         in the program of ICHIGLYPH_OP_JZ and
+	                         ICHIGLYPH_OP_JNZ) */
+	size_t target;      /**< Matching instruction of ICHIGLYPH_OP_JZ
+	                         and ICHIGLYPH_OP_JNZ */
+} ichiglyph_instruction_t;
+
+/** Compiled program */
+typedef struct ichiglyph_program ichiglyph_program_t;
+
+/** Virtual machine */
+typedef struct ichiglyph_vm ichiglyph_vm_t;
+
+/** Input callback
+ *
+ * @param arg    Argument of the callback.
+ * @param buffer Buffer to read the input to.
+ * @param size   Size of the buffer.
+ *
+ * @return Number of bytes read (0 at the end of the input,
+ *         negative value on error, which is also treated
+ *         as the end of the input).
+ *
+ */
+typedef ssize_t (*ichiglyph_read_t)(void *arg, uint8_t *buffer, size_t size);
+
+/** Output callback
+ *
+ * @param arg   Argument of the callback.
+ * @param bytes Bytes to write.
+ * @param count Number of bytes to write.
+ *
+ */
+typedef void (*ichiglyph_write_t)(void *arg, const uint8_t *bytes,
+    size_t count);
+
+/** Lane of the lockstep execution */
+typedef struct {
+	const void *input;          /**< Input bytes */
+	size_t input_size;          /**< Number of the input bytes */
+	ichiglyph_write_t write;    /**< Output callback */
+	void *write_arg;            /**< Argument of the output callback */
+	ichiglyph_result_t result;  /**< Result of the execution */
+	uint64_t executed;          /**< Number of the executed compiled
+	                                 instructions (counted only if
+	                                 the budget is limited) */
+} ichiglyph_lane_t;
+
+/** Execution counters */
+typedef struct {
+	uint64_t instructions;  /**< Dispatched compiled instructions */
+	uint64_t span;          /**< Data cells from the lowest to the highest
+	                             addressed one (including the data cells
+	                             in between that have not been addressed,
+	                             thus not the number of the addressed
+	                             data cells) */
+	uint64_t input;         /**< Calls of the input callback */
+	uint64_t output;        /**< Calls of the output callback */
+} ichiglyph_counters_t;
+
+extern ichiglyph_result_t ichiglyph_program_compile(
+    ichiglyph_language_t language, const void *source, size_t size,
+    bool fold, ichiglyph_program_t **program, size_t *unmatched);
+extern void ichiglyph_program_destroy(ichiglyph_program_t *program);
+extern bool ichiglyph_program_lockstep(const ichiglyph_program_t *program);
+extern size_t ichiglyph_program_size(const ichiglyph_program_t *program);
+extern void ichiglyph_program_instruction(const ichiglyph_program_t *program,
+    size_t ip, ichiglyph_instruction_t *instruction);
+
+extern ichiglyph_vm_t *ichiglyph_vm_create(ichiglyph_engine_t engine,
+    ichiglyph_tape_t tape);
+extern void ichiglyph_vm_destroy(ichiglyph_vm_t *vm);
+extern void ichiglyph_vm_set_perf(ichiglyph_vm_t *vm, unsigned int perf);
+extern void ichiglyph_vm_set_counting(ichiglyph_vm_t *vm, bool counting);
+extern void ichiglyph_vm_set_input(ichiglyph_vm_t *vm, ichiglyph_read_t read,
+    void *arg);
+extern void ichiglyph_vm_set_input_memory(ichiglyph_vm_t *vm,
+    const void *input, size_t size);
+extern void ichiglyph_vm_set_output(ichiglyph_vm_t *vm,
+    ichiglyph_write_t write, void *arg, ichiglyph_buffer_t buffer);
+extern ichiglyph_result_t ichiglyph_vm_run(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, uint64_t budget);
+extern size_t ichiglyph_vm_consumed(ichiglyph_vm_t *vm);
+extern uint64_t ichiglyph_vm_executed(ichiglyph_vm_t *vm);
+extern void ichiglyph_vm_counters(ichiglyph_vm_t *vm,
+    ichiglyph_counters_t *counters);
+extern ichiglyph_result_t ichiglyph_vm_profile(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, const void *source, size_t size,
+    const char *name, ichiglyph_profile_t format, size_t top,
+    ichiglyph_write_t write, void *arg);
+extern ichiglyph_result_t ichiglyph_vm_run_lockstep(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, ichiglyph_lane_t *lanes, size_t count,
+    uint64_t budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
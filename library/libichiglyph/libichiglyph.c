@@ -0,0 +1,5158 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is the Ichiglyph library. It compiles Ichiglyph (or Brainfuck)
+ * programs and executes them in virtual machines. Ichiglyph is
+ * a simple Turing-complete language derived from Brainfuck (as
+ * defined by https://en.wikipedia.org/wiki/Brainfuck).
+ *
+ * Ichiglyph and Brainfuck implement the same set of instructions,
+ * the only major difference is their encoding. The following table
+ * presents the encoding of the instructions of both languages.
+ *
+ * Brainfuck | Ichiglyph
+ * ----------+----------
+ * >         | ll
+ * <         | lI
+ * +         | Il
+ * -         | II
+ * .         | 1l
+ * ,         | 1I
+ * [         | l1
+ * ]         | I1
+ *
+ * All the state of an execution (the data memory, the input and
+ * the output) is kept in the virtual machine and the compiled
+ * programs are never modified once compiled, thus the library
+ * is reentrant.
+ *
+ * The Ichiglyph language was inspired by a remark by Josefina Madrova,
+ * who cleverly noted that using the characters l, I and 1 in identifiers
+ * is a bad practice.
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <assert.h>
+#include "ichiglyph.h"
+
+#ifdef __SSE2__
+	#include <immintrin.h>
+#endif
+
+/** Minimal size of the dynamic data memory */
+#define DATA_GRANULARITY  32768
+
+/** Size of the virtual data memory */
+#if SIZE_MAX > UINT32_MAX
+	#define DATA_RESERVE  ((size_t) 1 << 32)
+#else
+	#define DATA_RESERVE  ((size_t) 1 << 28)
+#endif
+
+/** Size of the output buffer */
+#define OUTPUT_BUFFER_SIZE  65536
+
+/** Size of the input buffer */
+#define INPUT_BUFFER_SIZE  65536
+
+/** Maximal number of compiled instructions evaluated in advance */
+#define FOLD_BUDGET  1048576
+
+/** Maximal stride of vectorized scans */
+#define SCAN_SIMD_STRIDE  16
+
+/** Threaded handlers accessing the virtual data memory unchecked */
+#define THREAD_UNCHECKED  1
+
+/** Threaded handlers counting the back edges of the loops */
+#define THREAD_TIERED  2
+
+/** Threaded handlers counting the instructions and data cells */
+#define THREAD_COUNTING  4
+
+/** Number of the variants of the threaded handlers */
+#define THREAD_VARIANTS  8
+
+/** Maximal size of the native code of the JIT preamble */
+#define JIT_PREAMBLE_SIZE  160
+
+/** Maximal size of the native code of a compiled instruction */
+#define JIT_INSTRUCTION_SIZE  80
+
+/** Maximal size of the native code counting a compiled instruction */
+#define JIT_COUNT_SIZE  48
+
+/** Magic number of the jitdump file ('JiTD') */
+#define JITDUMP_MAGIC  0x4a695444
+
+/** Version of the jitdump file */
+#define JITDUMP_VERSION  1
+
+/** Jitdump record of loaded native code */
+#define JITDUMP_CODE_LOAD  0
+
+/** ELF machine of the jitdump file (EM_X86_64) */
+#define JITDUMP_MACHINE  62
+
+/** Minimal number of the positions of the lockstep data memory */
+#define LOCKSTEP_GRANULARITY  1024
+
+/** Size of the output buffer of a lane */
+#define LANE_BUFFER_SIZE  4096
+
+/** Number of the back edges of a loop that make it hot */
+#define TIER_THRESHOLD  1000
+
+/** Number of the buckets of the trip count histograms */
+#define PROFILE_BUCKETS  65
+
+/** Maximal length of the Brainfuck rendering of a loop */
+#define PROFILE_RENDER  64
+
+/** Return value of an execution engine that is not available */
+#define ENGINE_UNAVAILABLE  (-2)
+
+/** Return value of an execution engine that exhausted the budget */
+#define ENGINE_BUDGET  (-3)
+
+/** Return value of the native code of a loop that left the loop */
+#define ENGINE_CONTINUE  (-4)
+
+/** Ichiglyph/Brainfuck instructions
+ *
+ * These are the eight Ichiglyph and Brainfuck instructions. The INST_NOP
+ * instruction represets any other program input that should
+ * be simply ignored.
+ *
+ */
+typedef enum {
+	INST_DP_INC,
+	INST_DP_DEC,
+	INST_VAL_INC,
+	INST_VAL_DEC,
+	INST_VAL_OUTPUT,
+	INST_VAL_ACCEPT,
+	INST_JMP_FORWARD,
+	INST_JMP_BACK,
+	INST_NOP
+} instruction_t;
+
+/** Compiled instructions
+ *
+ * The program is compiled into a compact stream of these
+ * instructions before the execution. Runs of identical
+ * instructions are folded into a single compiled instruction
+ * with an argument, the NOPs are stripped and some common
+ * loop idioms are replaced by dedicated instructions. The
+ * instructions operating on data cells address them by an
+ * offset relative to the data pointer.
+ *
+ */
+typedef enum {
+	CODE_MOVE,    /**< Move the data pointer by the argument */
+	CODE_ADD,     /**< Add the argument to the data cell at the offset */
+	CODE_SET,     /**< Set the data cell at the offset to the argument */
+	CODE_MUL,     /**< Add the data cell multiplied by the argument
+	                   to the data cell at the offset */
+	CODE_SCAN,    /**< Move the data pointer by the argument until
+	                   a zero data cell is found */
+	CODE_OUTPUT,  /**< Output the data cell at the offset */
+	CODE_ACCEPT,  /**< Accept the data cell at the offset from
+	                   the input */
+	CODE_CAT,     /**< Copy the input to the output while the data
+	                   cell is non-zero */
+	CODE_JZ,      /**< Jump to the target if the data cell is zero */
+	CODE_JNZ,     /**< Jump to the target if the data cell is non-zero */
+	CODE_HALT     /**< Terminate the execution */
+} code_op_t;
+
+/** Compiled instruction */
+typedef struct {
+	code_op_t op;   /**< Operation */
+	ssize_t arg;     /**< Argument of CODE_MOVE, CODE_ADD, CODE_SET,
+	                      CODE_MUL, CODE_SCAN and CODE_CAT (or the
+	                      budget charged by CODE_JZ and CODE_JNZ) */
+	ssize_t offset;  /**< Data cell offset of CODE_ADD, CODE_SET,
+	                      CODE_MUL, CODE_OUTPUT and CODE_ACCEPT (or
+	                      the position of the bracket in the program
+	                      of CODE_JZ and CODE_JNZ) */
+	size_t target;   /**< Matching instruction of CODE_JZ and CODE_JNZ */
+} code_t;
+
+/** Source language */
+typedef struct {
+	const char *name;    /**< Name of the language */
+	size_t opcode_size;  /**< Size of an instruction opcode */
+
+	/** Decode instruction opcode */
+	instruction_t (*decode)(const uint8_t *);
+} language_t;
+
+/** Data memory
+ *
+ * Ichiglyph data memory is unbounded by definition (in both
+ * directions). To accomodate such abstraction we resize the
+ * actual data memory on demand. The data memory is grown
+ * geometrically using anonymous memory mappings (which are
+ * zero-filled by the kernel and can be resized without copying
+ * when growing to the right).
+ *
+ * The data pointer is relative to the origin and it can be
+ * negative. The data cells allocated left of the origin are
+ * tracked separately, thus the data cell at the data pointer
+ * is within the allocated data memory if ((size_t) dp + low)
+ * is less than size (a single comparison).
+ *
+ * Alternatively, a large virtual data memory is reserved
+ * in advance (the kernel provides the zero pages lazily) with
+ * the origin in the middle and surrounded by read-only guard
+ * areas. The data cells can be then accessed without any
+ * checks, because the accesses beyond the data memory hit
+ * the guard areas. Reading them yields zero and writing them
+ * faults.
+ *
+ */
+typedef struct {
+	uint8_t *data;  /**< Data cell at the origin */
+	size_t low;     /**< Number of allocated data cells left of
+	                     the origin */
+	size_t size;    /**< Number of allocated data cells */
+	size_t guard;   /**< Size of the guard areas (0 if the data
+	                     memory is resized on demand) */
+} data_t;
+
+#ifdef __x86_64__
+
+/** Native code being generated */
+typedef struct {
+	uint8_t *buffer;  /**< Native code buffer */
+	size_t size;      /**< Size of the native code buffer */
+	size_t pos;       /**< Current position in the native code buffer */
+	bool checked;     /**< Whether the data cell accesses are checked */
+	bool budget;      /**< Whether the budget is charged */
+	bool counting;    /**< Whether the instructions and data cells
+	                       are counted */
+	unsigned int perf;  /**< Perf output of the native code */
+} jit_t;
+
+/** Entry point of the native code
+ *
+ * @param vm Virtual machine.
+ * @param dp Data pointer (updated by the native code).
+ *
+ */
+typedef int (*jit_entry_t)(ichiglyph_vm_t *vm, ssize_t *dp);
+
+/** Jitdump file header (as defined by Linux perf) */
+typedef struct {
+	uint32_t magic;       /**< Magic number */
+	uint32_t version;     /**< Version */
+	uint32_t total_size;  /**< Size of the header */
+	uint32_t elf_mach;    /**< ELF machine */
+	uint32_t pad1;        /**< Padding */
+	uint32_t pid;         /**< Process ID */
+	uint64_t timestamp;   /**< Time of the creation */
+	uint64_t flags;       /**< Flags */
+} jitdump_header_t;
+
+/** Jitdump record of loaded native code
+ *
+ * The record is followed by the name of the native code
+ * (terminated by zero) and the native code itself.
+ *
+ */
+typedef struct {
+	uint32_t id;          /**< Record type */
+	uint32_t total_size;  /**< Size of the record */
+	uint64_t timestamp;   /**< Time of the record */
+	uint32_t pid;         /**< Process ID */
+	uint32_t tid;         /**< Thread ID */
+	uint64_t vma;         /**< Virtual address of the native code */
+	uint64_t code_addr;   /**< Address of the native code */
+	uint64_t code_size;   /**< Size of the native code */
+	uint64_t code_index;  /**< Unique index of the native code */
+} jitdump_load_t;
+
+#endif
+
+/** Data cells of all lanes at the same position
+ *
+ * The data memory of the lockstep execution is interleaved,
+ * i.e. the byte i of the vector is the data cell of lane i.
+ * The vector operations are provided by the GCC vector
+ * extensions (compiled to SSE2 on x86-64).
+ *
+ */
+typedef uint8_t lanes_t __attribute__((vector_size(ICHIGLYPH_LANES)));
+
+/** Lane of the lockstep execution */
+typedef struct {
+	const uint8_t *input;      /**< Input bytes */
+	size_t input_size;         /**< Number of the input bytes */
+	size_t input_pos;          /**< Position of the next input byte */
+	ichiglyph_write_t write;   /**< Output callback */
+	void *write_arg;           /**< Argument of the output callback */
+	size_t output_pos;         /**< Number of bytes in the output
+	                                buffer */
+	uint64_t budget;           /**< Remaining budget */
+	ichiglyph_result_t result; /**< Result of the execution */
+	uint8_t output_buffer[LANE_BUFFER_SIZE];  /**< Output buffer */
+} lane_t;
+
+/** Lockstep execution
+ *
+ * The data memory is resized on demand similarly to the
+ * dynamic data memory (the data pointer is shared by all
+ * lanes).
+ *
+ */
+typedef struct {
+	lanes_t *memory;   /**< Allocated data cells */
+	lanes_t *data;     /**< Data cells at the origin */
+	size_t low;        /**< Number of allocated positions left of
+	                        the origin */
+	size_t size;       /**< Number of allocated positions */
+	lanes_t *stack;    /**< Active lanes at the entry of the
+	                        enclosing loops */
+	size_t depth;      /**< Size of the stack */
+	lane_t lanes[ICHIGLYPH_LANES];  /**< Lanes */
+} lockstep_t;
+
+/** Execution profile
+ *
+ * The loops are indexed by the position of their CODE_JZ
+ * instruction. The bucket 0 of the trip count histogram counts
+ * the entries without any iteration, the bucket i counts the
+ * entries with 2^(i - 1) to 2^i - 1 iterations.
+ *
+ */
+typedef struct {
+	uint64_t serial;    /**< Serial number of the profiled program
+	                         (0 if there is no profile) */
+	size_t size;        /**< Number of the compiled instructions */
+	uint64_t *counts;   /**< Executions of each compiled instruction */
+	uint64_t *trips;    /**< Iterations of the current entry of each
+	                         loop */
+	uint64_t (*histogram)[PROFILE_BUCKETS];  /**< Trip count histogram
+	                                              of each loop */
+} profile_t;
+
+/** Execution counters
+ *
+ * The data cells addressed by the dispatched compiled instructions
+ * span from the lowest to the highest one (there are none if the
+ * highest is below the lowest).
+ *
+ */
+typedef struct {
+	uint64_t instructions;  /**< Dispatched compiled instructions */
+	ssize_t low;            /**< Lowest addressed data cell */
+	ssize_t high;           /**< Highest addressed data cell */
+	uint64_t input;         /**< Calls of the input callback */
+	uint64_t output;        /**< Calls of the output callback */
+} counters_t;
+
+/** Tiered execution
+ *
+ * The loops are indexed by the position of their CODE_JZ
+ * instruction. The back edges of each loop are counted by the
+ * threaded engine and once the loop becomes hot, its body is
+ * compiled to native code and the execution continues in the
+ * native code until the loop is left. The native code is kept
+ * for the subsequent executions of the same program.
+ *
+ */
+typedef struct {
+	uint64_t serial;   /**< Serial number of the program (0 if there
+	                        is no state of the tiered execution) */
+	size_t size;       /**< Number of the compiled instructions */
+	uint32_t *counts;  /**< Back edges of each loop since its last
+	                        compilation */
+#ifdef __x86_64__
+	jit_t *loops;      /**< Native code of each loop (NULL buffer
+	                        if not compiled yet) */
+#endif
+} tier_t;
+
+/** Compiled program */
+struct ichiglyph_program {
+	code_t *code;        /**< Compiled code */
+	size_t code_size;    /**< Number of compiled instructions */
+	language_t *language;  /**< Source language */
+	bool folded;         /**< Whether the beginning of the code has
+	                          been evaluated in advance */
+	size_t reach;        /**< Maximal data cell offset */
+	uint8_t *prefix;     /**< Output of the code evaluated in advance */
+	size_t prefix_size;  /**< Number of bytes of the output */
+	uint64_t prefix_charge;  /**< Budget charged by the code
+	                              evaluated in advance */
+	ichiglyph_program_t *unfolded;  /**< The same program without
+	                                     the evaluation in advance
+	                                     (NULL if not folded) */
+	uint64_t serial;     /**< Unique serial number */
+	bool lockstep;       /**< Whether the code can be executed
+	                          in lockstep */
+	size_t lockstep_reach;  /**< Maximal data cell offset relative
+	                             to the data pointer */
+	size_t lockstep_depth;  /**< Maximal nesting of the loops */
+
+	/** Handler addresses of the threaded engine (translated
+	    lazily for each combination of THREAD_* flags) */
+	const void **thread[THREAD_VARIANTS];
+};
+
+/** Virtual machine
+ *
+ * The data memory is the first member, thus the native code
+ * can pass the virtual machine to the data memory functions.
+ *
+ */
+struct ichiglyph_vm {
+	data_t data;                  /**< Data memory */
+	uint64_t budget;              /**< Remaining budget */
+	uint64_t limit;               /**< Budget of the last execution */
+	ichiglyph_engine_t engine;    /**< Execution engine */
+	ichiglyph_tape_t tape;        /**< Data memory mode */
+	bool dirty;                   /**< Whether the data memory was used */
+	unsigned int perf;            /**< Perf output of the native code
+	                                   (ichiglyph_perf_t flags) */
+	bool counting;                /**< Whether the instructions and
+	                                   the data cells are counted */
+	counters_t counters;          /**< Counters of the last execution */
+
+	ichiglyph_write_t write;      /**< Output callback */
+	void *write_arg;              /**< Argument of the output callback */
+	size_t output_pos;            /**< Number of bytes in the output
+	                                   buffer */
+	size_t output_limit;          /**< Number of bytes in the output
+	                                   buffer that trigger a flush */
+	bool output_line;             /**< Whether the output buffer is
+	                                   flushed at the end of each line */
+
+	ichiglyph_read_t read;        /**< Input callback */
+	void *read_arg;               /**< Argument of the input callback */
+	const uint8_t *input_memory;  /**< Input supplied in the memory */
+	size_t input_memory_size;     /**< Size of the input in the memory */
+	const uint8_t *input_data;    /**< Input bytes (either the input
+	                                   buffer or the input memory) */
+	size_t input_pos;             /**< Position of the next input byte */
+	size_t input_size;            /**< Number of input bytes available */
+	bool input_eof;               /**< Whether the end of the input has
+	                                   been reached */
+
+#ifdef __x86_64__
+	jit_t jit;                    /**< Native code of the last program */
+	uint64_t jit_serial;          /**< Serial number of the last program
+	                                   (0 if there is no native code) */
+#endif
+
+	lockstep_t *lockstep;         /**< Lockstep execution (allocated on
+	                                   demand) */
+	profile_t profile;            /**< Execution profile of the last
+	                                   program */
+	tier_t tier;                  /**< Tiered execution of the last
+	                                   program */
+
+	uint8_t output_buffer[OUTPUT_BUFFER_SIZE];  /**< Output buffer */
+	uint8_t input_buffer[INPUT_BUFFER_SIZE];    /**< Input buffer */
+};
+
+/** State of the code evaluated in advance */
+typedef struct {
+	size_t ip;           /**< Instruction pointer */
+	ssize_t dp;          /**< Data pointer */
+	size_t steps;        /**< Number of executed compiled instructions */
+	uint64_t charge;     /**< Budget charged by the executed jumps */
+	uint8_t *output;     /**< Output buffer */
+	size_t output_size;  /**< Number of bytes in the output buffer */
+} fold_t;
+
+/** Decode Ichiglyph instruction opcode
+ *
+ * Decode the Ichiglyph instruction opcode. The eight valid
+ * instruction characters are decoded to the respective
+ * instructions, any unrecognized characters are interpretted
+ * as a NOP.
+ *
+ * @param opcode Instruction opcode.
+ *
+ * @return Decoded instruction.
+ *
+ */
+static instruction_t ichiglyph_opcode_decode(const uint8_t *opcode)
+{
+	switch (opcode[0]) {
+	case 'l':
+		switch (opcode[1]) {
+		case 'l':
+			return INST_DP_INC;
+		case 'I':
+			return INST_DP_DEC;
+		case '1':
+			return INST_JMP_FORWARD;
+		default:
+			return INST_NOP;
+		}
+	case 'I':
+		switch (opcode[1]) {
+		case 'l':
+			return INST_VAL_INC;
+		case 'I':
+			return INST_VAL_DEC;
+		case '1':
+			return INST_JMP_BACK;
+		default:
+			return INST_NOP;
+		}
+	case '1':
+		switch (opcode[1]) {
+		case 'l':
+			return INST_VAL_OUTPUT;
+		case 'I':
+			return INST_VAL_ACCEPT;
+		default:
+			return INST_NOP;
+		}
+	default:
+		return INST_NOP;
+	}
+}
+
+/** Decode Brainfuck instruction opcode
+ *
+ * Decode the Brainfuck instruction opcode. The eight valid
+ * instruction characters are decoded to the respective
+ * instructions, any unrecognized characters are interpretted
+ * as a NOP.
+ *
+ * @param opcode Instruction opcode.
+ *
+ * @return Decoded instruction.
+ *
+ */
+static instruction_t brainfuck_opcode_decode(const uint8_t *opcode)
+{
+	switch (opcode[0]) {
+	case '>':
+		return INST_DP_INC;
+	case '<':
+		return INST_DP_DEC;
+	case '+':
+		return INST_VAL_INC;
+	case '-':
+		return INST_VAL_DEC;
+	case '.':
+		return INST_VAL_OUTPUT;
+	case ',':
+		return INST_VAL_ACCEPT;
+	case '[':
+		return INST_JMP_FORWARD;
+	case ']':
+		return INST_JMP_BACK;
+	default:
+		return INST_NOP;
+	}
+}
+
+/** Supported source languages (indexed by ichiglyph_language_t) */
+static language_t languages[] = {
+	[ICHIGLYPH_LANGUAGE_ICHIGLYPH] = {
+		.name = "ichiglyph",
+		.opcode_size = 2,
+		.decode = ichiglyph_opcode_decode
+	},
+	[ICHIGLYPH_LANGUAGE_BRAINFUCK] = {
+		.name = "brainfuck",
+		.opcode_size = 1,
+		.decode = brainfuck_opcode_decode
+	}
+};
+
+/** Initialize data memory
+ *
+ * Initialize data memory. Actually no memory is allocated.
+ *
+ * @param data Data memory to initialize.
+ *
+ */
+static void data_init(data_t *data)
+{
+	data->data = NULL;
+	data->low = 0;
+	data->size = 0;
+	data->guard = 0;
+}
+
+/** Data memory whose guard areas are being watched by this thread */
+static __thread data_t *data_fault_data;
+
+/** Context to return to when a guard area is written */
+static __thread sigjmp_buf *data_fault_context;
+
+/** Fault handlers installed before the guard area handler */
+static struct sigaction data_fault_previous[2];
+
+/** Whether the guard area handler is installed */
+static bool data_fault_installed = false;
+
+/** Guard area handler installation control */
+static pthread_once_t data_fault_once = PTHREAD_ONCE_INIT;
+
+/** Handle a write to a guard area
+ *
+ * If the faulting address belongs to one of the guard areas
+ * of the virtual data memory watched by the current thread,
+ * return to the context saved by execute(). Any other fault
+ * is passed to the previously installed handler (or it is
+ * fatal).
+ *
+ * @param signo   Signal number.
+ * @param info    Signal information.
+ * @param context Interrupted context.
+ *
+ */
+static void data_fault(int signo, siginfo_t *info, void *context)
+{
+	data_t *data = data_fault_data;
+	
+	if (data != NULL) {
+		uint8_t *addr = (uint8_t *) info->si_addr;
+		uint8_t *base = data->data - data->low;
+		
+		if ((addr >= base - data->guard) &&
+		    (addr < base + data->size + data->guard))
+			siglongjmp(*data_fault_context, 1);
+	}
+	
+	struct sigaction *previous =
+	    &data_fault_previous[(signo == SIGSEGV) ? 0 : 1];
+	
+	if ((previous->sa_flags & SA_SIGINFO) != 0) {
+		previous->sa_sigaction(signo, info, context);
+		return;
+	}
+	
+	if ((previous->sa_handler != SIG_DFL) &&
+	    (previous->sa_handler != SIG_IGN)) {
+		previous->sa_handler(signo);
+		return;
+	}
+	
+	signal(signo, SIG_DFL);
+}
+
+/** Install the guard area handler
+ *
+ * The handler is installed just once for the whole process and
+ * only if the virtual data memory is requested by the caller of
+ * the library.
+ *
+ */
+static void data_fault_install(void)
+{
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = data_fault;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	
+	if ((sigaction(SIGSEGV, &action, &data_fault_previous[0]) == 0) &&
+	    (sigaction(SIGBUS, &action, &data_fault_previous[1]) == 0))
+		data_fault_installed = true;
+}
+
+/** Reserve virtual data memory
+ *
+ * Reserve the virtual data memory surrounded by the guard
+ * areas. The origin is placed in the middle of the virtual
+ * data memory. The guard areas need to be large enough to be hit
+ * by any access beyond the data memory, thus they span at
+ * least the given reach. The guard areas are mapped
+ * read-only, thus the data cells beyond the data memory
+ * read as zero (as in the dynamic data memory).
+ *
+ * @param data  Data memory (initialized).
+ * @param reach Maximal distance of a data cell accessed
+ *              beyond the data memory.
+ *
+ * @return 0 if the virtual data memory was reserved.
+ * @return Non-zero value if the virtual data memory cannot
+ *         be reserved (the data memory is left intact).
+ *
+ */
+static int data_reserve(data_t *data, size_t reach)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t guard = (reach / page + 1) * page;
+	
+	if (guard > (SIZE_MAX - DATA_RESERVE) / 2)
+		return -1;
+	
+	uint8_t *area = (uint8_t *) mmap(NULL, DATA_RESERVE + 2 * guard,
+	    PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (area == MAP_FAILED)
+		return -1;
+	
+	if (mprotect(area + guard, DATA_RESERVE, PROT_READ | PROT_WRITE) != 0) {
+		munmap(area, DATA_RESERVE + 2 * guard);
+		return -1;
+	}
+	
+	pthread_once(&data_fault_once, data_fault_install);
+	
+	if (!data_fault_installed) {
+		munmap(area, DATA_RESERVE + 2 * guard);
+		return -1;
+	}
+	
+	data->data = area + guard + DATA_RESERVE / 2;
+	data->low = DATA_RESERVE / 2;
+	data->size = DATA_RESERVE;
+	data->guard = guard;
+	return 0;
+}
+
+/** Cleanup data memory
+ *
+ * Free the data memory.
+ *
+ * @param data Data memory to be freed.
+ *
+ */
+static void data_done(data_t *data)
+{
+	uint8_t *base = data->data - data->low;
+	
+	if (data->guard != 0)
+		munmap(base - data->guard, data->size + 2 * data->guard);
+	else if (data->data != NULL)
+		munmap(base, data->size);
+	
+	data->data = NULL;
+	data->low = 0;
+	data->size = 0;
+	data->guard = 0;
+}
+
+/** Clear data memory
+ *
+ * Reset all data cells to 0. The pages of the virtual data
+ * memory are discarded (the kernel provides fresh zero pages
+ * lazily again), the dynamic data memory is freed.
+ *
+ * @param data Data memory to be cleared.
+ *
+ */
+static void data_clear(data_t *data)
+{
+	if ((data->guard != 0) &&
+	    (madvise(data->data - data->low, data->size, MADV_DONTNEED) == 0))
+		return;
+	
+	data_done(data);
+}
+
+/** Check data memory access bound
+ *
+ * Make sure the access to the data memory is safe
+ * by resizing the data memory to the required size.
+ * The part of the data memory on the side of the data
+ * pointer is at least doubled, thus a program walking
+ * across the data memory causes only a logarithmic number
+ * of resizes. When growing to the right, the data memory
+ * is remapped (without copying if possible). When growing
+ * to the left, the data cells are copied to a new mapping.
+ * In both cases the new data cells come from fresh
+ * anonymous pages, which are initialized to 0.
+ *
+ * @param data Data memory.
+ * @param dp   Data memory pointer.
+ *
+ * @return 0 if the data cell can be safely accessed.
+ * @return Non-zero value if the data cell cannot be accessed
+ *         (out-of-memory condition).
+ *
+ */
+static int data_bound(data_t *data, ssize_t dp)
+{
+	if ((size_t) dp + data->low >= data->size) {
+		/*
+		 * The virtual data memory cannot be resized.
+		 */
+		if (data->guard != 0)
+			return -1;
+		
+		if ((dp > SSIZE_MAX / 4) || (dp < -(SSIZE_MAX / 4)))
+			return -1;
+		
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t low = data->low;
+		size_t high = data->size - data->low;
+		
+		if (dp < 0) {
+			if (low < DATA_GRANULARITY)
+				low = DATA_GRANULARITY;
+			
+			while (low < (size_t) -dp)
+				low *= 2;
+			
+			low = (low + page - 1) / page * page;
+		} else {
+			if (high < DATA_GRANULARITY)
+				high = DATA_GRANULARITY;
+			
+			while (high <= (size_t) dp)
+				high *= 2;
+			
+			high = (high + page - 1) / page * page;
+		}
+		
+		uint8_t *base = data->data - data->low;
+		uint8_t *area;
+		
+		if ((data->data != NULL) && (low == data->low)) {
+#ifdef MREMAP_MAYMOVE
+			area = (uint8_t *) mremap(base, data->size, low + high,
+			    MREMAP_MAYMOVE);
+#else
+			area = (uint8_t *) mmap(NULL, low + high,
+			    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (area != MAP_FAILED) {
+				memcpy(area, base, data->size);
+				munmap(base, data->size);
+			}
+#endif
+		} else {
+			area = (uint8_t *) mmap(NULL, low + high,
+			    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if ((area != MAP_FAILED) && (data->data != NULL)) {
+				memcpy(area + low - data->low, base, data->size);
+				munmap(base, data->size);
+			}
+		}
+		
+		if (area == MAP_FAILED)
+			return -1;
+		
+		data->data = area + low;
+		data->low = low;
+		data->size = low + high;
+	}
+	
+	return 0;
+}
+
+/** Add to the value of a data cell
+ *
+ * Add a value to the data cell at the data pointer
+ * (modulo the data cell size).
+ *
+ * @param data Data memory.
+ * @param dp   Data memory pointer.
+ * @param val  Value to add.
+ *
+ * @return 0 if the data cell was changed.
+ * @return Non-zero value if the data cell cannot be changed
+ *         (out-of-memory condition).
+ *
+ */
+static int data_add(data_t *data, ssize_t dp, uint8_t val)
+{
+	int ret = data_bound(data, dp);
+	if (ret != 0)
+		return ret;
+	
+	data->data[dp] += val;
+	return 0;
+}
+
+/** Get the value of a data cell
+ *
+ * Get the value of a data cell at the data pointer. Data
+ * cells are initialized to 0.
+ *
+ * @param data Data memory.
+ * @param dp   Data memory pointer.
+ *
+ * @return Value of the data cell.
+ *
+ */
+static uint8_t data_get(data_t *data, ssize_t dp)
+{
+	if ((size_t) dp + data->low >= data->size)
+		return 0;
+	
+	return data->data[dp];
+}
+
+/** Set the value of a data cell
+ *
+ * Set the value of a data cell at the data pointer.
+ *
+ * @param data Data memory.
+ * @param dp   Data memory pointer.
+ * @param val  New data cell value.
+ *
+ * @return 0 if the data cell was set.
+ * @return Non-zero value if the data cell cannot be set
+ *         (out-of-memory condition).
+ *
+ */
+static int data_set(data_t *data, ssize_t dp, uint8_t val)
+{
+	int ret = data_bound(data, dp);
+	if (ret != 0)
+		return ret;
+	
+	data->data[dp] = val;
+	return 0;
+}
+
+/** Compute the candidate mask of a vectorized scan
+ *
+ * Compute the mask of the vector lanes that are visited by
+ * a scan, provided that the first lane (or the last lane in
+ * case of a reverse scan) is visited.
+ *
+ * @param stride  Scan stride.
+ * @param width   Vector width (in data cells).
+ * @param reverse Whether the vector lanes are visited from
+ *                the last one to the first one.
+ *
+ * @return Candidate mask.
+ *
+ */
+static uint32_t scan_mask(size_t stride, size_t width, bool reverse)
+{
+	uint32_t mask = 0;
+	
+	for (size_t lane = 0; lane < width; lane += stride) {
+		if (reverse)
+			mask |= UINT32_C(1) << (width - 1 - lane);
+		else
+			mask |= UINT32_C(1) << lane;
+	}
+	
+	return mask;
+}
+
+#ifdef __SSE2__
+
+/** Compute the mask of zero data cells (SSE2)
+ *
+ * @param data Data cells (16 of them).
+ *
+ * @return Mask of the zero data cells.
+ *
+ */
+static inline uint32_t scan_zero_sse2(const uint8_t *data)
+{
+	__m128i cells = _mm_loadu_si128((const __m128i *) data);
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(cells, _mm_setzero_si128()));
+}
+
+/** Compute the mask of zero data cells (AVX2)
+ *
+ * @param data Data cells (32 of them).
+ *
+ * @return Mask of the zero data cells.
+ *
+ */
+static inline __attribute__((target("avx2")))
+uint32_t scan_zero_avx2(const uint8_t *data)
+{
+	__m256i cells = _mm256_loadu_si256((const __m256i *) data);
+	return _mm256_movemask_epi8(_mm256_cmpeq_epi8(cells,
+	    _mm256_setzero_si256()));
+}
+
+/** Vectorized forward scan
+ *
+ * Find the first zero data cell at or after the given position
+ * visiting every stride-th data cell. The position is relative
+ * to the start of the allocated data memory and it needs to be
+ * within the allocated data memory. The data cells beyond the
+ * allocated data memory are zero.
+ *
+ * @param data   Data memory.
+ * @param pos    Position of the first data cell.
+ * @param stride Scan stride (up to SCAN_SIMD_STRIDE).
+ * @param width  Vector width (in data cells).
+ * @param zero   Function computing the mask of zero data cells
+ *               of a vector.
+ *
+ * @return Position of the zero data cell.
+ *
+ */
+static inline __attribute__((always_inline))
+size_t scan_forward_simd(data_t *data, size_t pos, size_t stride,
+    size_t width, uint32_t (*zero)(const uint8_t *))
+{
+	const uint8_t *cells = data->data - data->low;
+	uint32_t mask = scan_mask(stride, width, false);
+	size_t step = width % stride;
+	size_t phase = 0;
+	
+	while (pos + width <= data->size) {
+		/*
+		 * The phase is the distance of the first data cell
+		 * of the vector from the data pointer (modulo the
+		 * stride).
+		 */
+		uint32_t hit = zero(cells + pos) &
+		    (mask << ((stride - phase) % stride));
+		if (hit != 0)
+			return pos + __builtin_ctz(hit);
+		
+		pos += width;
+		phase += step;
+		if (phase >= stride)
+			phase -= stride;
+	}
+	
+	pos += (stride - phase) % stride;
+	while ((pos < data->size) && (cells[pos] != 0))
+		pos += stride;
+	
+	return pos;
+}
+
+/** Vectorized backward scan
+ *
+ * Find the first zero data cell at or before the given position
+ * visiting every stride-th data cell. The position is relative
+ * to the start of the allocated data memory and it needs to be
+ * within the allocated data memory. The data cells before the
+ * allocated data memory are zero (the returned position wraps
+ * around in such case).
+ *
+ * @param data   Data memory.
+ * @param pos    Position of the first data cell.
+ * @param stride Scan stride (up to SCAN_SIMD_STRIDE).
+ * @param width  Vector width (in data cells).
+ * @param zero   Function computing the mask of zero data cells
+ *               of a vector.
+ *
+ * @return Position of the zero data cell.
+ *
+ */
+static inline __attribute__((always_inline))
+size_t scan_backward_simd(data_t *data, size_t pos, size_t stride,
+    size_t width, uint32_t (*zero)(const uint8_t *))
+{
+	const uint8_t *cells = data->data - data->low;
+	uint32_t mask = scan_mask(stride, width, true);
+	size_t step = width % stride;
+	size_t phase = 0;
+	size_t end = pos + 1;
+	
+	while (end >= width) {
+		/*
+		 * The phase is the distance of the last data cell
+		 * of the vector from the data pointer (modulo the
+		 * stride).
+		 */
+		uint32_t hit = zero(cells + end - width) &
+		    (mask >> ((stride - phase) % stride));
+		if (hit != 0)
+			return end - width + 31 - __builtin_clz(hit);
+		
+		end -= width;
+		phase += step;
+		if (phase >= stride)
+			phase -= stride;
+	}
+	
+	pos = end - 1 - (stride - phase) % stride;
+	while ((pos < end) && (cells[pos] != 0))
+		pos -= stride;
+	
+	return pos;
+}
+
+static size_t scan_forward_sse2(data_t *data, size_t pos, size_t stride)
+{
+	return scan_forward_simd(data, pos, stride, 16, scan_zero_sse2);
+}
+
+static size_t scan_backward_sse2(data_t *data, size_t pos, size_t stride)
+{
+	return scan_backward_simd(data, pos, stride, 16, scan_zero_sse2);
+}
+
+static __attribute__((target("avx2")))
+size_t scan_forward_avx2(data_t *data, size_t pos, size_t stride)
+{
+	return scan_forward_simd(data, pos, stride, 32, scan_zero_avx2);
+}
+
+static __attribute__((target("avx2")))
+size_t scan_backward_avx2(data_t *data, size_t pos, size_t stride)
+{
+	return scan_backward_simd(data, pos, stride, 32, scan_zero_avx2);
+}
+
+#endif
+
+/** Scan for a zero data cell
+ *
+ * Find the first zero data cell starting at the data pointer
+ * and moving by the given stride (i.e. execute a loop whose
+ * body consists only of moving the data pointer). Forward
+ * scans of single data cells use memchr(), other short
+ * strides are vectorized (using AVX2 if the CPU supports it,
+ * SSE2 otherwise) and the remaining scans are performed
+ * sequentially.
+ *
+ * @param data   Data memory.
+ * @param dp     Data memory pointer.
+ * @param stride Scan stride (non-zero).
+ *
+ * @return Position of the zero data cell.
+ *
+ */
+static ssize_t data_scan(data_t *data, ssize_t dp, ssize_t stride)
+{
+	/*
+	 * The scan is performed on the positions relative to the
+	 * start of the allocated data memory. The data cells beyond
+	 * the allocated data memory are zero.
+	 */
+	const uint8_t *cells = data->data - data->low;
+	size_t pos = (size_t) dp + data->low;
+	
+	if ((pos >= data->size) || (cells[pos] == 0))
+		return dp;
+	
+	if (stride == 1) {
+		const uint8_t *zero = (const uint8_t *) memchr(cells + pos, 0,
+		    data->size - pos);
+		pos = (zero != NULL) ? (size_t) (zero - cells) : data->size;
+	} else {
+#ifdef __SSE2__
+		/*
+		 * The CPU features are detected by a constructor of the
+		 * runtime library, thus checking them is just a load
+		 * (and it is safe in concurrently running machines).
+		 */
+		bool avx2 = __builtin_cpu_supports("avx2");
+		
+		if ((stride > 0) && (stride <= SCAN_SIMD_STRIDE))
+			pos = avx2 ? scan_forward_avx2(data, pos, stride) :
+			    scan_forward_sse2(data, pos, stride);
+		else if ((stride < 0) && (-stride <= SCAN_SIMD_STRIDE))
+			pos = avx2 ? scan_backward_avx2(data, pos, -stride) :
+			    scan_backward_sse2(data, pos, -stride);
+		else
+#endif
+		{
+			while ((pos < data->size) && (cells[pos] != 0))
+				pos += stride;
+		}
+	}
+	
+	return (ssize_t) (pos - data->low);
+}
+
+/** Flush the output buffer
+ *
+ * The output buffer is always flushed before waiting for the
+ * input (for the sake of interactive programs) and at the end
+ * of the execution.
+ *
+ * @param vm Virtual machine.
+ *
+ */
+static void output_flush(ichiglyph_vm_t *vm)
+{
+	if ((vm->output_pos > 0) && (vm->write != NULL)) {
+		vm->write(vm->write_arg, vm->output_buffer, vm->output_pos);
+		vm->counters.output++;
+	}
+	
+	vm->output_pos = 0;
+}
+
+/** Output a byte
+ *
+ * @param vm  Virtual machine.
+ * @param val Byte to output.
+ *
+ */
+static inline void output_put(ichiglyph_vm_t *vm, uint8_t val)
+{
+	vm->output_buffer[vm->output_pos++] = val;
+	
+	if ((vm->output_pos >= vm->output_limit) ||
+	    ((val == '\n') && (vm->output_line)))
+		output_flush(vm);
+}
+
+/** Output bytes
+ *
+ * Short runs of bytes are appended to the output buffer, long
+ * runs are passed to the output callback directly (without
+ * copying them).
+ *
+ * @param vm    Virtual machine.
+ * @param bytes Bytes to output.
+ * @param count Number of bytes to output.
+ *
+ */
+static void output_write(ichiglyph_vm_t *vm, const uint8_t *bytes,
+    size_t count)
+{
+	if ((vm->output_pos + count < vm->output_limit) && (!vm->output_line)) {
+		memcpy(vm->output_buffer + vm->output_pos, bytes, count);
+		vm->output_pos += count;
+		return;
+	}
+	
+	output_flush(vm);
+	
+	if ((count > 0) && (vm->write != NULL)) {
+		vm->write(vm->write_arg, bytes, count);
+		vm->counters.output++;
+	}
+}
+
+/** Reset the input
+ *
+ * The input supplied in the memory is consumed directly,
+ * otherwise the input is read in large blocks into the input
+ * buffer using the input callback.
+ *
+ * @param vm Virtual machine.
+ *
+ */
+static void input_reset(ichiglyph_vm_t *vm)
+{
+	if (vm->input_memory != NULL) {
+		vm->input_data = vm->input_memory;
+		vm->input_size = vm->input_memory_size;
+	} else {
+		vm->input_data = vm->input_buffer;
+		vm->input_size = 0;
+	}
+	
+	vm->input_pos = 0;
+	vm->input_eof = false;
+}
+
+/** Refill the input buffer
+ *
+ * The output buffer is flushed before the input callback
+ * is called.
+ *
+ * @param vm Virtual machine.
+ *
+ * @return Next input byte or EOF.
+ *
+ */
+static int input_fill(ichiglyph_vm_t *vm)
+{
+	if ((vm->input_eof) || (vm->input_memory != NULL) ||
+	    (vm->read == NULL)) {
+		vm->input_eof = true;
+		return EOF;
+	}
+	
+	output_flush(vm);
+	
+	ssize_t ret = vm->read(vm->read_arg, vm->input_buffer, INPUT_BUFFER_SIZE);
+	vm->counters.input++;
+	
+	if (ret <= 0) {
+		vm->input_eof = true;
+		return EOF;
+	}
+	
+	vm->input_pos = 1;
+	vm->input_size = ret;
+	return vm->input_buffer[0];
+}
+
+/** Input a byte
+ *
+ * @param vm Virtual machine.
+ *
+ * @return Next input byte or EOF.
+ *
+ */
+static inline int input_get(ichiglyph_vm_t *vm)
+{
+	if (vm->input_pos < vm->input_size)
+		return vm->input_data[vm->input_pos++];
+	
+	return input_fill(vm);
+}
+
+/** Copy the input to the output
+ *
+ * Execute CODE_CAT on a non-zero data cell, i.e. copy the
+ * input bytes to the output up to the first zero byte. The
+ * zero byte is output only if the loop accepts the data cell
+ * before outputting it (e.g. [,.]), while a loop outputting
+ * the data cell first (e.g. [.,]) outputs the original value
+ * of the data cell instead.
+ *
+ * @param vm    Virtual machine.
+ * @param val   Value of the data cell.
+ * @param first Whether the data cell is output before accepting.
+ *
+ * @return 0 if a zero byte has been copied (thus the data
+ *         cell becomes zero).
+ * @return EOF if the end of the input has been reached.
+ *
+ */
+static int input_cat(ichiglyph_vm_t *vm, uint8_t val, bool first)
+{
+	if (first)
+		output_put(vm, val);
+	
+	while (true) {
+		if (vm->input_pos == vm->input_size) {
+			if (input_fill(vm) == EOF)
+				return EOF;
+			
+			/* Return the first byte of the refilled input */
+			vm->input_pos--;
+		}
+		
+		const uint8_t *start = vm->input_data + vm->input_pos;
+		size_t count = vm->input_size - vm->input_pos;
+		const uint8_t *zero = (const uint8_t *) memchr(start, 0, count);
+		
+		if (zero == NULL) {
+			output_write(vm, start, count);
+			vm->input_pos += count;
+			continue;
+		}
+		
+		count = zero - start;
+		output_write(vm, start, first ? count : count + 1);
+		vm->input_pos += count + 1;
+		return 0;
+	}
+}
+
+/** Emit a compiled instruction
+ *
+ * Append a compiled instruction to the code. Consecutive
+ * CODE_MOVE instructions and consecutive CODE_ADD instructions
+ * operating on the same data cell are folded together and the
+ * instruction is dropped altogether if the folded argument
+ * becomes a no-op. Similarly, CODE_ADD is folded into
+ * a preceding CODE_SET and CODE_SET overrides a preceding
+ * CODE_ADD or CODE_SET operating on the same data cell.
+ *
+ * @param code      Code to append to.
+ * @param code_size Number of compiled instructions of the code.
+ * @param op        Operation of the instruction.
+ * @param arg       Argument of the instruction.
+ * @param offset    Data cell offset of the instruction.
+ *
+ */
+static void code_emit(code_t *code, size_t *code_size, code_op_t op,
+    ssize_t arg, ssize_t offset)
+{
+	if ((op == CODE_ADD) || (op == CODE_SET))
+		arg = (uint8_t) arg;
+	
+	if (*code_size > 0) {
+		code_t *last = &code[*code_size - 1];
+		
+		if (((op == CODE_MOVE) || (op == CODE_ADD)) && (last->op == op) &&
+		    (last->offset == offset)) {
+			last->arg += arg;
+			if (op == CODE_ADD)
+				last->arg = (uint8_t) last->arg;
+			
+			if (last->arg == 0)
+				(*code_size)--;
+			
+			return;
+		}
+		
+		if ((op == CODE_ADD) && (last->op == CODE_SET) &&
+		    (last->offset == offset)) {
+			last->arg = (uint8_t) (last->arg + arg);
+			return;
+		}
+		
+		if ((op == CODE_SET) &&
+		    ((last->op == CODE_ADD) || (last->op == CODE_SET)) &&
+		    (last->offset == offset)) {
+			last->op = CODE_SET;
+			last->arg = arg;
+			return;
+		}
+	}
+	
+	code[*code_size].op = op;
+	code[*code_size].arg = arg;
+	code[*code_size].offset = offset;
+	code[*code_size].target = 0;
+	(*code_size)++;
+}
+
+/** Replace loop idioms
+ *
+ * Check whether the loop starting with the CODE_JZ instruction
+ * at the given position and spanning to the end of the code
+ * (without the closing CODE_JNZ instruction) is a common idiom
+ * that can be replaced by straight-line code.
+ *
+ * A loop that only adds an odd value to the data cell (e.g. [-]
+ * or [+]) always terminates with the data cell cleared. It is
+ * replaced by CODE_SET (which is subsequently folded together
+ * with any CODE_ADD following it).
+ *
+ * A loop that only moves the data pointer (e.g. [>] or [<<<])
+ * is replaced by CODE_SCAN.
+ *
+ * A loop that only adds constant values to data cells at fixed
+ * offsets, returns to its original position and decrements
+ * (or increments) the original data cell by one (e.g. [->++<])
+ * is replaced by a sequence of CODE_MUL (one for each modified
+ * data cell) followed by a clearing CODE_SET.
+ *
+ * A loop that only accepts the data cell and outputs it (e.g.
+ * [,.] or [.,]) copies the input to the output until a zero
+ * byte is read. It is replaced by CODE_CAT.
+ *
+ * @param code      Code to examine.
+ * @param code_size Number of compiled instructions of the code.
+ * @param forward   Position of the CODE_JZ instruction.
+ *
+ * @return True if the loop has been replaced.
+ *
+ */
+static bool code_loop_idiom(code_t *code, size_t *code_size, size_t forward)
+{
+	size_t body = *code_size - forward - 1;
+	
+	if ((body == 1) && (code[forward + 1].op == CODE_ADD) &&
+	    (code[forward + 1].offset == 0) &&
+	    ((code[forward + 1].arg & 1) != 0)) {
+		*code_size = forward;
+		code_emit(code, code_size, CODE_SET, 0, 0);
+		return true;
+	}
+	
+	if ((body == 1) && (code[forward + 1].op == CODE_MOVE)) {
+		ssize_t stride = code[forward + 1].arg;
+		
+		*code_size = forward;
+		code_emit(code, code_size, CODE_SCAN, stride, 0);
+		return true;
+	}
+	
+	if ((body == 2) && (code[forward + 1].offset == 0) &&
+	    (code[forward + 2].offset == 0) &&
+	    (((code[forward + 1].op == CODE_ACCEPT) &&
+	    (code[forward + 2].op == CODE_OUTPUT)) ||
+	    ((code[forward + 1].op == CODE_OUTPUT) &&
+	    (code[forward + 2].op == CODE_ACCEPT)))) {
+		bool first = (code[forward + 1].op == CODE_OUTPUT);
+		
+		*code_size = forward;
+		code_emit(code, code_size, CODE_CAT, first, 0);
+		return true;
+	}
+	
+	/*
+	 * Check that the loop body consists only of additions
+	 * (the zero net movement of the data pointer implies no
+	 * CODE_MOVE at the end of the loop body).
+	 */
+	uint8_t counter = 0;
+	
+	for (size_t ip = forward + 1; ip < *code_size; ip++) {
+		if (code[ip].op != CODE_ADD)
+			return false;
+		
+		if (code[ip].offset == 0)
+			counter += code[ip].arg;
+	}
+	
+	if ((counter != 1) && (counter != UINT8_MAX))
+		return false;
+	
+	/*
+	 * Gather the factors of the modified data cells. If the
+	 * original data cell is incremented, the number of
+	 * iterations is its negated value.
+	 */
+	ssize_t *offsets = (ssize_t *) malloc(body * sizeof(ssize_t));
+	uint8_t *factors = (uint8_t *) malloc(body * sizeof(uint8_t));
+	if ((offsets == NULL) || (factors == NULL)) {
+		free(offsets);
+		free(factors);
+		return false;
+	}
+	
+	size_t targets = 0;
+	
+	for (size_t ip = forward + 1; ip < *code_size; ip++) {
+		if (code[ip].offset == 0)
+			continue;
+		
+		uint8_t factor = code[ip].arg;
+		if (counter == 1)
+			factor = -factor;
+		
+		size_t target;
+		for (target = 0; target < targets; target++) {
+			if (offsets[target] == code[ip].offset)
+				break;
+		}
+		
+		if (target == targets) {
+			offsets[target] = code[ip].offset;
+			factors[target] = 0;
+			targets++;
+		}
+		
+		factors[target] += factor;
+	}
+	
+	*code_size = forward;
+	
+	for (size_t target = 0; target < targets; target++) {
+		if (factors[target] != 0)
+			code_emit(code, code_size, CODE_MUL, factors[target],
+			    offsets[target]);
+	}
+	
+	code_emit(code, code_size, CODE_SET, 0, 0);
+	
+	free(offsets);
+	free(factors);
+	return true;
+}
+
+/** Compile program
+ *
+ * Compile the program into a stream of compiled instructions.
+ * All the INST_JMP_FORWARD and INST_JMP_BACK instructions are
+ * matched in a single pass and the position of the matching
+ * instruction is stored as the target of each of them, thus
+ * each jump can be executed in a constant time. The code is
+ * always terminated by a CODE_HALT instruction.
+ *
+ * The data pointer moves are not compiled immediately. The
+ * subsequent instructions operate on data cells at an offset
+ * from the data pointer instead and the net movement is
+ * compiled into a single CODE_MOVE at the end of each basic
+ * block (i.e. before each jump).
+ *
+ * @param language     Language of the program.
+ * @param program      Program to compile.
+ * @param program_size Number of instructions of the program.
+ * @param code         Compiled code (set only on success,
+ *                     to be freed by the caller).
+ * @param code_size    Number of compiled instructions of the code
+ *                     (set only on success).
+ * @param unmatched    Position of the first unmatched instruction
+ *                     (set only on failure).
+ *
+ * @return 0 if the program was compiled.
+ * @return Non-zero value if there is an unmatched bracket or
+ *         the compilation could not be performed (out-of-memory
+ *         condition, unmatched is set to program_size).
+ *
+ */
+static int program_compile(language_t *language, const uint8_t *program,
+    size_t program_size, code_t **code, size_t *code_size, size_t *unmatched)
+{
+	/*
+	 * The compiled code is never longer than the program
+	 * (plus the terminating instruction).
+	 */
+	code_t *compiled = (code_t *) malloc((program_size + 1) * sizeof(code_t));
+	if (compiled == NULL) {
+		*unmatched = program_size;
+		return -1;
+	}
+	
+	/*
+	 * The stack of the currently open INST_JMP_FORWARD
+	 * instructions (their positions in the compiled code
+	 * and in the program).
+	 */
+	size_t *stack = (size_t *) malloc(2 * program_size * sizeof(size_t));
+	if ((stack == NULL) && (program_size > 0)) {
+		free(compiled);
+		*unmatched = program_size;
+		return -1;
+	}
+	
+	size_t depth = 0;
+	size_t size = 0;
+	ssize_t offset = 0;
+	size_t forward;
+	
+	for (size_t ip = 0; ip < program_size; ip++) {
+		switch (language->decode(program + ip * language->opcode_size)) {
+		case INST_DP_INC:
+			offset++;
+			break;
+		case INST_DP_DEC:
+			offset--;
+			break;
+		case INST_VAL_INC:
+			code_emit(compiled, &size, CODE_ADD, 1, offset);
+			break;
+		case INST_VAL_DEC:
+			code_emit(compiled, &size, CODE_ADD, -1, offset);
+			break;
+		case INST_VAL_OUTPUT:
+			code_emit(compiled, &size, CODE_OUTPUT, 0, offset);
+			break;
+		case INST_VAL_ACCEPT:
+			code_emit(compiled, &size, CODE_ACCEPT, 0, offset);
+			break;
+		case INST_JMP_FORWARD:
+			if (offset != 0) {
+				code_emit(compiled, &size, CODE_MOVE, offset, 0);
+				offset = 0;
+			}
+			
+			stack[2 * depth] = size;
+			stack[2 * depth + 1] = ip;
+			depth++;
+			
+			code_emit(compiled, &size, CODE_JZ, 0, ip);
+			break;
+		case INST_JMP_BACK:
+			if (depth == 0) {
+				free(stack);
+				free(compiled);
+				*unmatched = ip;
+				return -1;
+			}
+			
+			if (offset != 0) {
+				code_emit(compiled, &size, CODE_MOVE, offset, 0);
+				offset = 0;
+			}
+			
+			depth--;
+			forward = stack[2 * depth];
+			
+			if (code_loop_idiom(compiled, &size, forward))
+				break;
+			
+			compiled[forward].target = size;
+			code_emit(compiled, &size, CODE_JNZ, 0, ip);
+			compiled[size - 1].target = forward;
+			break;
+		case INST_NOP:
+			break;
+		}
+	}
+	
+	if (depth != 0) {
+		*unmatched = stack[2 * (depth - 1) + 1];
+		free(stack);
+		free(compiled);
+		return -1;
+	}
+	
+	free(stack);
+	
+	/*
+	 * The final data pointer movement can be safely dropped.
+	 */
+	code_emit(compiled, &size, CODE_HALT, 0, 0);
+	*code = compiled;
+	*code_size = size;
+	return 0;
+}
+
+/** Get the bucket of the trip count histogram
+ *
+ * @param trips Number of the iterations of a loop entry.
+ *
+ * @return Bucket of the trip count histogram.
+ *
+ */
+static inline size_t profile_bucket(uint64_t trips)
+{
+	if (trips == 0)
+		return 0;
+	
+	return 64 - __builtin_clzll(trips);
+}
+
+/** Count an addressed data cell
+ *
+ * @param counters Execution counters.
+ * @param dp       Data memory pointer of the data cell.
+ *
+ */
+static inline void counters_touch(counters_t *counters, ssize_t dp)
+{
+	if (dp < counters->low)
+		counters->low = dp;
+	
+	if (dp > counters->high)
+		counters->high = dp;
+}
+
+/** Count a dispatched compiled instruction
+ *
+ * The data cells addressed by the compiled instruction are
+ * counted before its execution (the data cells visited by
+ * CODE_SCAN are covered by counting its final position
+ * afterwards).
+ *
+ * @param counters Execution counters.
+ * @param code     Compiled instruction.
+ * @param dp       Data memory pointer.
+ *
+ */
+static inline void counters_count(counters_t *counters, const code_t *code,
+    ssize_t dp)
+{
+	counters->instructions++;
+	
+	switch (code->op) {
+	case CODE_ADD:
+	case CODE_SET:
+	case CODE_OUTPUT:
+	case CODE_ACCEPT:
+		counters_touch(counters, dp + code->offset);
+		break;
+	case CODE_MUL:
+		counters_touch(counters, dp);
+		counters_touch(counters, dp + code->offset);
+		break;
+	case CODE_SCAN:
+	case CODE_CAT:
+	case CODE_JZ:
+	case CODE_JNZ:
+		counters_touch(counters, dp);
+		break;
+	case CODE_MOVE:
+	case CODE_HALT:
+		break;
+	}
+}
+
+/** Execute compiled code using the switch engine
+ *
+ * Execute the compiled code by dispatching each compiled
+ * instruction through a single switch statement. This is
+ * the simple reference execution engine. Optionally, the
+ * executions of the compiled instructions and the trip counts
+ * of the loops are recorded in the profile and the dispatched
+ * compiled instructions and the addressed data cells are
+ * counted. The engine is instantiated separately with and
+ * without these hooks, thus the plain execution does not pay
+ * for them.
+ *
+ * @param vm       Virtual machine.
+ * @param code     Compiled code.
+ * @param profile  Execution profile (NULL if not profiling).
+ * @param counters Execution counters (NULL if not counting).
+ *
+ * @return 0 if the execution terminated normally.
+ * @return ENGINE_BUDGET if the budget has been exhausted.
+ * @return Other non-zero value if the execution cannot continue
+ *         (out-of-memory condition).
+ *
+ */
+static inline __attribute__((always_inline))
+int execute_switch_generic(ichiglyph_vm_t *vm, code_t *code,
+    profile_t *profile, counters_t *counters)
+{
+	data_t *data = &vm->data;
+	size_t ip = 0;
+	ssize_t dp = 0;
+	
+	while (true) {
+		uint8_t val;
+		int input_val;
+		int ret;
+		
+		if (profile != NULL)
+			profile->counts[ip]++;
+		
+		if (counters != NULL)
+			counters_count(counters, &code[ip], dp);
+		
+		switch (code[ip].op) {
+		case CODE_MOVE:
+			dp += code[ip].arg;
+			break;
+		case CODE_ADD:
+			ret = data_add(data, dp + code[ip].offset, code[ip].arg);
+			if (ret != 0)
+				return ret;
+			
+			break;
+		case CODE_SET:
+			ret = data_set(data, dp + code[ip].offset, code[ip].arg);
+			if (ret != 0)
+				return ret;
+			
+			break;
+		case CODE_MUL:
+			val = data_get(data, dp);
+			if (val != 0) {
+				ret = data_add(data, dp + code[ip].offset,
+				    val * code[ip].arg);
+				if (ret != 0)
+					return ret;
+			}
+			
+			break;
+		case CODE_SCAN:
+			dp = data_scan(data, dp, code[ip].arg);
+			if (counters != NULL)
+				counters_touch(counters, dp);
+			
+			break;
+		case CODE_OUTPUT:
+			val = data_get(data, dp + code[ip].offset);
+			output_put(vm, val);
+			break;
+		case CODE_ACCEPT:
+			input_val = input_get(vm);
+			if (input_val == EOF)
+				return 0;
+			
+			ret = data_set(data, dp + code[ip].offset, input_val);
+			if (ret != 0)
+				return ret;
+			
+			break;
+		case CODE_CAT:
+			val = data_get(data, dp);
+			if (val != 0) {
+				if (input_cat(vm, val, code[ip].arg) == EOF)
+					return 0;
+				
+				ret = data_set(data, dp, 0);
+				if (ret != 0)
+					return ret;
+			}
+			
+			break;
+		case CODE_JZ:
+			if (vm->budget < (uint64_t) code[ip].arg)
+				return ENGINE_BUDGET;
+			
+			vm->budget -= code[ip].arg;
+			val = data_get(data, dp);
+			
+			if (profile != NULL) {
+				if (val == 0)
+					profile->histogram[ip][0]++;
+				else
+					profile->trips[ip] = 1;
+			}
+			
+			if (val == 0)
+				ip = code[ip].target;
+			
+			break;
+		case CODE_JNZ:
+			if (vm->budget < (uint64_t) code[ip].arg)
+				return ENGINE_BUDGET;
+			
+			vm->budget -= code[ip].arg;
+			val = data_get(data, dp);
+			
+			if (profile != NULL) {
+				size_t loop = code[ip].target;
+				
+				if (val != 0)
+					profile->trips[loop]++;
+				else
+					profile->histogram[loop][
+					    profile_bucket(profile->trips[loop])]++;
+			}
+			
+			if (val != 0)
+				ip = code[ip].target;
+			
+			break;
+		case CODE_HALT:
+			return 0;
+		}
+		
+		ip++;
+	}
+}
+
+static int execute_switch(ichiglyph_vm_t *vm, code_t *code)
+{
+	return execute_switch_generic(vm, code, NULL, NULL);
+}
+
+static int execute_switch_hooked(ichiglyph_vm_t *vm, code_t *code,
+    profile_t *profile, counters_t *counters)
+{
+	return execute_switch_generic(vm, code, profile, counters);
+}
+
+/** Evaluate compiled code in advance
+ *
+ * Execute the compiled code (similarly to the switch engine)
+ * with the output stored to the output buffer until the input
+ * is needed, the execution terminates or the budget of executed
+ * compiled instructions is exhausted. The state is recorded
+ * whenever the execution is outside of any loop (including the
+ * budget the engines would have charged up to that point).
+ *
+ * @param code   Compiled code.
+ * @param data   Data memory.
+ * @param budget Maximal number of compiled instructions to execute.
+ * @param fold   Last recorded state (the output buffer needs to
+ *               hold at least budget bytes).
+ *
+ * @return 0 if the evaluation terminated normally.
+ * @return Non-zero value if the evaluation cannot continue
+ *         (out-of-memory condition).
+ *
+ */
+static int code_evaluate(code_t *code, data_t *data, size_t budget,
+    fold_t *fold)
+{
+	size_t ip = 0;
+	ssize_t dp = 0;
+	size_t depth = 0;
+	size_t steps = 0;
+	uint64_t charge = 0;
+	size_t output_size = 0;
+	
+	while (true) {
+		uint8_t val;
+		int ret;
+		
+		if (depth == 0) {
+			fold->ip = ip;
+			fold->dp = dp;
+			fold->steps = steps;
+			fold->charge = charge;
+			fold->output_size = output_size;
+		}
+		
+		if (steps == budget)
+			return 0;
+		
+		steps++;
+		
+		switch (code[ip].op) {
+		case CODE_MOVE:
+			dp += code[ip].arg;
+			break;
+		case CODE_ADD:
+			ret = data_add(data, dp + code[ip].offset, code[ip].arg);
+			if (ret != 0)
+				return ret;
+			
+			break;
+		case CODE_SET:
+			ret = data_set(data, dp + code[ip].offset, code[ip].arg);
+			if (ret != 0)
+				return ret;
+			
+			break;
+		case CODE_MUL:
+			val = data_get(data, dp);
+			if (val != 0) {
+				ret = data_add(data, dp + code[ip].offset,
+				    val * code[ip].arg);
+				if (ret != 0)
+					return ret;
+			}
+			
+			break;
+		case CODE_SCAN:
+			dp = data_scan(data, dp, code[ip].arg);
+			break;
+		case CODE_OUTPUT:
+			fold->output[output_size++] =
+			    data_get(data, dp + code[ip].offset);
+			break;
+		case CODE_CAT:
+			if (data_get(data, dp) == 0)
+				break;
+			
+			return 0;
+		case CODE_JZ:
+			charge += code[ip].arg;
+			if (data_get(data, dp) == 0)
+				ip = code[ip].target;
+			else
+				depth++;
+			
+			break;
+		case CODE_JNZ:
+			charge += code[ip].arg;
+			if (data_get(data, dp) != 0)
+				ip = code[ip].target;
+			else
+				depth--;
+			
+			break;
+		case CODE_ACCEPT:
+		case CODE_HALT:
+			return 0;
+		}
+		
+		ip++;
+	}
+}
+
+/** Fold the constant output
+ *
+ * Evaluate the beginning of the compiled code that does not
+ * depend on the input in advance. The evaluated part of the
+ * code is replaced by CODE_SET instructions restoring the
+ * non-zero data cells (relative to the data pointer, thus the
+ * residual code starts with the data pointer at the origin)
+ * and its output is to be written at once.
+ *
+ * The evaluation resumes from the last state outside of any
+ * loop, thus the rest of the code does not jump back into the
+ * evaluated part. The code is left unchanged if a restored
+ * data cell lies beyond the reach of the data pointer.
+ *
+ * The code needs to be charged (see code_charge()) and the
+ * residual code keeps the original charges of the jumps (the
+ * CODE_SET instructions are not charged), thus an execution of
+ * the residual code charges the same budget as the rest of the
+ * execution of the original code.
+ *
+ * @param code        Compiled code (replaced on success).
+ * @param code_size   Number of compiled instructions of the code.
+ * @param reach       Maximal data cell offset.
+ * @param output      Output of the evaluated part (set only
+ *                    on success).
+ * @param output_size Number of bytes of the output (set only
+ *                    on success).
+ * @param charge      Budget charged by the jumps of the evaluated
+ *                    part (set only on success, to be charged by
+ *                    each execution).
+ *
+ * @return 0 if the code has been folded.
+ * @return Non-zero value if the code has been left unchanged.
+ *
+ */
+static int code_fold(code_t **code, size_t *code_size, size_t reach,
+    uint8_t **output, size_t *output_size, uint64_t *charge)
+{
+	fold_t fold;
+	fold.output = (uint8_t *) malloc(FOLD_BUDGET);
+	if (fold.output == NULL)
+		return -1;
+	
+	data_t data;
+	data_init(&data);
+	
+	int ret = code_evaluate(*code, &data, FOLD_BUDGET, &fold);
+	data_done(&data);
+	
+	if ((ret != 0) || (fold.steps == 0)) {
+		free(fold.output);
+		return -1;
+	}
+	
+	/*
+	 * Replay the evaluation up to the last state outside
+	 * of any loop.
+	 */
+	data_init(&data);
+	ret = code_evaluate(*code, &data, fold.steps, &fold);
+	
+	uint8_t *base = data.data - data.low;
+	size_t cells = 0;
+	
+	if ((ret == 0) && ((*code)[fold.ip].op != CODE_HALT)) {
+		for (size_t pos = 0; pos < data.size; pos++) {
+			if (base[pos] == 0)
+				continue;
+			
+			ssize_t offset = (ssize_t) (pos - data.low) - fold.dp;
+			if ((offset < -(ssize_t) reach) || (offset > (ssize_t) reach)) {
+				ret = -1;
+				break;
+			}
+			
+			cells++;
+		}
+	}
+	
+	code_t *residual = NULL;
+	if (ret == 0) {
+		residual = (code_t *) malloc((cells + *code_size - fold.ip) *
+		    sizeof(code_t));
+		if (residual == NULL)
+			ret = -1;
+	}
+	
+	if (ret != 0) {
+		data_done(&data);
+		free(fold.output);
+		return ret;
+	}
+	
+	size_t size = 0;
+	
+	for (size_t pos = 0; (cells > 0) && (pos < data.size); pos++) {
+		uint8_t val = base[pos];
+		if (val != 0)
+			code_emit(residual, &size, CODE_SET, val,
+			    (ssize_t) (pos - data.low) - fold.dp);
+	}
+	
+	data_done(&data);
+	
+	for (size_t ip = fold.ip; ip < *code_size; ip++) {
+		residual[size] = (*code)[ip];
+		
+		if ((residual[size].op == CODE_JZ) || (residual[size].op == CODE_JNZ))
+			residual[size].target += size - ip;
+		
+		size++;
+	}
+	
+	free(*code);
+	
+	/*
+	 * Shrink the output buffer to the actual output.
+	 */
+	if (fold.output_size == 0) {
+		free(fold.output);
+		fold.output = NULL;
+	} else {
+		uint8_t *shrunk = (uint8_t *) realloc(fold.output, fold.output_size);
+		if (shrunk != NULL)
+			fold.output = shrunk;
+	}
+	
+	*code = residual;
+	*code_size = size;
+	*output = fold.output;
+	*output_size = fold.output_size;
+	*charge = fold.charge;
+	return 0;
+}
+
+/** Compute the budget charged by the jumps
+ *
+ * The execution proceeds in straight-line segments, each of
+ * them starting right after a jump (or at the beginning of the
+ * code) and ending with the next jump in the code. Each jump
+ * thus charges the number of the compiled instructions of the
+ * segment it ends, which accounts for all the executed compiled
+ * instructions but the final segment.
+ *
+ * @param code      Compiled code.
+ * @param code_size Number of compiled instructions of the code.
+ *
+ */
+static void code_charge(code_t *code, size_t code_size)
+{
+	size_t start = 0;
+	
+	for (size_t ip = 0; ip < code_size; ip++) {
+		if ((code[ip].op == CODE_JZ) || (code[ip].op == CODE_JNZ)) {
+			code[ip].arg = ip + 1 - start;
+			start = ip + 1;
+		}
+	}
+}
+
+/** Check whether compiled code can be executed in lockstep
+ *
+ * The lanes of the lockstep execution share the data pointer,
+ * thus each loop must leave the data pointer where it found it
+ * (regardless of the number of its iterations) and CODE_SCAN
+ * is not supported.
+ *
+ * @param code      Compiled code.
+ * @param code_size Number of compiled instructions of the code.
+ * @param reach     Maximal data cell offset relative to the data
+ *                  pointer (set only on success).
+ * @param depth     Maximal nesting of the loops (set only on
+ *                  success).
+ *
+ * @return True if the code can be executed in lockstep.
+ *
+ */
+static bool code_lockstep(code_t *code, size_t code_size, size_t *reach,
+    size_t *depth)
+{
+	ssize_t *entry = (ssize_t *) malloc(code_size * sizeof(ssize_t));
+	if (entry == NULL)
+		return false;
+	
+	ssize_t dp = 0;
+	size_t level = 0;
+	size_t max_reach = 0;
+	size_t max_level = 0;
+	bool ret = true;
+	
+	for (size_t ip = 0; (ip < code_size) && (ret); ip++) {
+		size_t offset = (code[ip].offset < 0) ?
+		    (size_t) -code[ip].offset : (size_t) code[ip].offset;
+		
+		switch (code[ip].op) {
+		case CODE_MOVE:
+			dp += code[ip].arg;
+			break;
+		case CODE_SCAN:
+			ret = false;
+			break;
+		case CODE_JZ:
+			entry[level++] = dp;
+			if (level > max_level)
+				max_level = level;
+			
+			break;
+		case CODE_JNZ:
+			if (entry[--level] != dp)
+				ret = false;
+			
+			break;
+		default:
+			if (offset > max_reach)
+				max_reach = offset;
+			
+			break;
+		}
+	}
+	
+	free(entry);
+	
+	if (ret) {
+		*reach = max_reach;
+		*depth = max_level;
+	}
+	
+	return ret;
+}
+
+static int tier_enter(ichiglyph_vm_t *vm, const ichiglyph_program_t *program,
+    tier_t *tier, size_t loop, ssize_t *dp);
+
+/** Execute compiled code using the threaded engine
+ *
+ * Execute the compiled code using direct threading. The
+ * compiled code is first translated into a parallel array
+ * of handler addresses (using the GCC labels-as-values
+ * extension) and each handler dispatches the next compiled
+ * instruction by itself. Each handler thus has its own
+ * indirect branch, which gives the branch predictor a chance
+ * to learn the typical sequences of instructions.
+ *
+ * The data cells of the virtual data memory are accessed by
+ * a separate set of handlers without any checks.
+ *
+ * Optionally, the back edges of the loops are counted and the
+ * hot loops are compiled to native code and entered from the
+ * back edge in the middle of the execution (on-stack
+ * replacement). If the counting has been set, each compiled
+ * instruction is first dispatched to a handler counting it.
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ * @param tier    Tiered execution (NULL if not tiered).
+ *
+ * @return 0 if the execution terminated normally.
+ * @return ENGINE_BUDGET if the budget has been exhausted.
+ * @return Other non-zero value if the execution cannot continue
+ *         (out-of-memory condition).
+ *
+ */
+static int execute_threaded(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, tier_t *tier)
+{
+	static const void *const handlers[] = {
+		[CODE_MOVE] = &&handler_move,
+		[CODE_ADD] = &&handler_add,
+		[CODE_SET] = &&handler_set,
+		[CODE_MUL] = &&handler_mul,
+		[CODE_SCAN] = &&handler_scan,
+		[CODE_OUTPUT] = &&handler_output,
+		[CODE_ACCEPT] = &&handler_accept,
+		[CODE_CAT] = &&handler_cat,
+		[CODE_JZ] = &&handler_jz,
+		[CODE_JNZ] = &&handler_jnz,
+		[CODE_HALT] = &&handler_halt
+	};
+	
+	static const void *const handlers_unchecked[] = {
+		[CODE_MOVE] = &&handler_move,
+		[CODE_ADD] = &&handler_add_unchecked,
+		[CODE_SET] = &&handler_set_unchecked,
+		[CODE_MUL] = &&handler_mul_unchecked,
+		[CODE_SCAN] = &&handler_scan,
+		[CODE_OUTPUT] = &&handler_output_unchecked,
+		[CODE_ACCEPT] = &&handler_accept_unchecked,
+		[CODE_CAT] = &&handler_cat_unchecked,
+		[CODE_JZ] = &&handler_jz_unchecked,
+		[CODE_JNZ] = &&handler_jnz_unchecked,
+		[CODE_HALT] = &&handler_halt
+	};
+	
+	code_t *code = program->code;
+	size_t code_size = program->code_size;
+	
+	/*
+	 * The handler addresses are translated just once for each
+	 * variant of the program. The programs are shared by the
+	 * virtual machines, thus the first translation wins.
+	 */
+	unsigned int variant = ((vm->data.guard != 0) ? THREAD_UNCHECKED : 0) |
+	    ((tier != NULL) ? THREAD_TIERED : 0) |
+	    ((vm->counting) ? THREAD_COUNTING : 0);
+	const void ***cached = (const void ***) &program->thread[variant];
+	const void **thread = __atomic_load_n(cached, __ATOMIC_ACQUIRE);
+	
+	if (thread == NULL) {
+		const void **translated =
+		    (const void **) malloc(code_size * sizeof(const void *));
+		if (translated == NULL)
+			return -1;
+		
+		for (size_t i = 0; i < code_size; i++) {
+			if (vm->counting)
+				translated[i] = &&handler_count;
+			else if ((tier != NULL) && (code[i].op == CODE_JNZ))
+				translated[i] = &&handler_jnz_tiered;
+			else if (vm->data.guard != 0)
+				translated[i] = handlers_unchecked[code[i].op];
+			else
+				translated[i] = handlers[code[i].op];
+		}
+		
+		if (__atomic_compare_exchange_n(cached, &thread, translated, false,
+		    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			thread = translated;
+		else
+			free(translated);
+	}
+	
+	/*
+	 * The counting handler dispatches the compiled instruction
+	 * to its handler once it has been counted.
+	 */
+	const void *const *dispatch = (vm->data.guard != 0) ?
+	    handlers_unchecked : handlers;
+	
+	data_t *data = &vm->data;
+	uint64_t budget = vm->budget;
+	uint8_t *cells = data->data;
+	size_t ip = 0;
+	ssize_t dp = 0;
+	uint8_t val;
+	int input_val;
+	int ret = 0;
+	
+#define DISPATCH() \
+	goto *thread[ip]
+	
+#define NEXT() \
+	do { \
+		ip++; \
+		DISPATCH(); \
+	} while (0)
+	
+#define CHARGE() \
+	do { \
+		if (budget < (uint64_t) code[ip].arg) { \
+			ret = ENGINE_BUDGET; \
+			goto handler_halt; \
+		} \
+		\
+		budget -= code[ip].arg; \
+	} while (0)
+	
+	DISPATCH();
+	
+handler_move:
+	dp += code[ip].arg;
+	NEXT();
+	
+handler_add:
+	ret = data_add(data, dp + code[ip].offset, code[ip].arg);
+	if (ret != 0)
+		goto handler_halt;
+	
+	NEXT();
+	
+handler_set:
+	ret = data_set(data, dp + code[ip].offset, code[ip].arg);
+	if (ret != 0)
+		goto handler_halt;
+	
+	NEXT();
+	
+handler_mul:
+	val = data_get(data, dp);
+	if (val != 0) {
+		ret = data_add(data, dp + code[ip].offset, val * code[ip].arg);
+		if (ret != 0)
+			goto handler_halt;
+	}
+	
+	NEXT();
+	
+handler_scan:
+	dp = data_scan(data, dp, code[ip].arg);
+	NEXT();
+	
+handler_output:
+	output_put(vm, data_get(data, dp + code[ip].offset));
+	NEXT();
+	
+handler_accept:
+	input_val = input_get(vm);
+	if (input_val == EOF)
+		goto handler_halt;
+	
+	ret = data_set(data, dp + code[ip].offset, input_val);
+	if (ret != 0)
+		goto handler_halt;
+	
+	NEXT();
+	
+handler_cat:
+	val = data_get(data, dp);
+	if (val != 0) {
+		if (input_cat(vm, val, code[ip].arg) == EOF)
+			goto handler_halt;
+		
+		ret = data_set(data, dp, 0);
+		if (ret != 0)
+			goto handler_halt;
+	}
+	
+	NEXT();
+	
+handler_jz:
+	CHARGE();
+	if (data_get(data, dp) == 0)
+		ip = code[ip].target;
+	
+	NEXT();
+	
+handler_jnz:
+	CHARGE();
+	if (data_get(data, dp) != 0)
+		ip = code[ip].target;
+	
+	NEXT();
+	
+handler_add_unchecked:
+	cells[dp + code[ip].offset] += code[ip].arg;
+	NEXT();
+	
+handler_set_unchecked:
+	cells[dp + code[ip].offset] = code[ip].arg;
+	NEXT();
+	
+handler_mul_unchecked:
+	val = cells[dp];
+	if (val != 0)
+		cells[dp + code[ip].offset] += val * code[ip].arg;
+	
+	NEXT();
+	
+handler_output_unchecked:
+	output_put(vm, cells[dp + code[ip].offset]);
+	NEXT();
+	
+handler_accept_unchecked:
+	input_val = input_get(vm);
+	if (input_val == EOF)
+		goto handler_halt;
+	
+	cells[dp + code[ip].offset] = input_val;
+	NEXT();
+	
+handler_cat_unchecked:
+	val = cells[dp];
+	if (val != 0) {
+		if (input_cat(vm, val, code[ip].arg) == EOF)
+			goto handler_halt;
+		
+		cells[dp] = 0;
+	}
+	
+	NEXT();
+	
+handler_jz_unchecked:
+	CHARGE();
+	if (cells[dp] == 0)
+		ip = code[ip].target;
+	
+	NEXT();
+	
+handler_jnz_unchecked:
+	CHARGE();
+	if (cells[dp] != 0)
+		ip = code[ip].target;
+	
+	NEXT();
+	
+handler_jnz_tiered:
+	CHARGE();
+	if (data_get(data, dp) != 0) {
+		ip = code[ip].target;
+		if (++tier->counts[ip] >= TIER_THRESHOLD)
+			goto handler_osr;
+	}
+	
+	NEXT();
+	
+handler_count:
+	counters_count(&vm->counters, &code[ip], dp);
+	
+	if (code[ip].op == CODE_SCAN)
+		goto handler_scan_counted;
+	
+	if ((tier != NULL) && (code[ip].op == CODE_JNZ))
+		goto handler_jnz_tiered;
+	
+	goto *dispatch[code[ip].op];
+	
+handler_scan_counted:
+	dp = data_scan(data, dp, code[ip].arg);
+	counters_touch(&vm->counters, dp);
+	NEXT();
+	
+handler_osr:
+	/*
+	 * Continue the loop in its native code. The back edge
+	 * counter stays just below the threshold, thus the next
+	 * entry of the loop enters the native code again after
+	 * the first iteration.
+	 */
+	tier->counts[ip] = TIER_THRESHOLD - 1;
+	
+	vm->budget = budget;
+	ret = tier_enter(vm, program, tier, ip, &dp);
+	budget = vm->budget;
+	cells = data->data;
+	
+	if (ret == ENGINE_CONTINUE) {
+		ret = 0;
+		ip = code[ip].target;
+		NEXT();
+	}
+	
+	/*
+	 * Keep interpreting the loop if the native code cannot
+	 * be generated.
+	 */
+	if (ret == ENGINE_UNAVAILABLE) {
+		ret = 0;
+		tier->counts[ip] = 0;
+		NEXT();
+	}
+	
+	goto handler_halt;
+	
+handler_halt:
+	vm->budget = budget;
+	
+#undef CHARGE
+#undef NEXT
+#undef DISPATCH
+	
+	return ret;
+}
+
+#ifdef __x86_64__
+
+/*
+ * The native code addresses these members of the virtual machine
+ * by 8-bit displacements relative to R14.
+ */
+_Static_assert(offsetof(ichiglyph_vm_t, data.data) < 128,
+    "data.data is not addressable by an 8-bit displacement");
+_Static_assert(offsetof(ichiglyph_vm_t, data.low) < 128,
+    "data.low is not addressable by an 8-bit displacement");
+_Static_assert(offsetof(ichiglyph_vm_t, data.size) < 128,
+    "data.size is not addressable by an 8-bit displacement");
+_Static_assert(offsetof(ichiglyph_vm_t, budget) < 128,
+    "budget is not addressable by an 8-bit displacement");
+
+/** Emit native code bytes */
+#define JIT_EMIT(jit, ...) \
+	jit_emit((jit), (const uint8_t []) { __VA_ARGS__ }, \
+	    sizeof((const uint8_t []) { __VA_ARGS__ }))
+
+/** Emit native code
+ *
+ * @param jit   Native code being generated.
+ * @param bytes Bytes to emit.
+ * @param count Number of bytes to emit.
+ *
+ */
+static void jit_emit(jit_t *jit, const uint8_t *bytes, size_t count)
+{
+	assert(jit->pos + count <= jit->size);
+	
+	memcpy(jit->buffer + jit->pos, bytes, count);
+	jit->pos += count;
+}
+
+/** Emit 32-bit immediate
+ *
+ * @param jit Native code being generated.
+ * @param imm Immediate value.
+ *
+ */
+static void jit_imm32(jit_t *jit, int32_t imm)
+{
+	jit_emit(jit, (const uint8_t *) &imm, sizeof(imm));
+}
+
+/** Emit 64-bit immediate
+ *
+ * @param jit Native code being generated.
+ * @param imm Immediate value.
+ *
+ */
+static void jit_imm64(jit_t *jit, uint64_t imm)
+{
+	jit_emit(jit, (const uint8_t *) &imm, sizeof(imm));
+}
+
+/** Emit relative 32-bit displacement
+ *
+ * @param jit    Native code being generated.
+ * @param target Position of the target in the native code buffer.
+ *
+ */
+static void jit_rel32(jit_t *jit, size_t target)
+{
+	jit_imm32(jit, (int32_t) (target - (jit->pos + sizeof(int32_t))));
+}
+
+/** Emit a call of a C function
+ *
+ * The arguments are expected to be already in the registers
+ * according to the System V AMD64 calling convention.
+ *
+ * @param jit      Native code being generated.
+ * @param function Function to call.
+ *
+ */
+static void jit_call(jit_t *jit, const void *function)
+{
+	/* mov rax, function; call rax */
+	JIT_EMIT(jit, 0x48, 0xb8);
+	jit_imm64(jit, (uint64_t) (uintptr_t) function);
+	JIT_EMIT(jit, 0xff, 0xd0);
+}
+
+/** Emit computing the position of the data cell to RSI
+ *
+ * @param jit    Native code being generated.
+ * @param offset Offset of the data cell from the data pointer.
+ *
+ */
+static void jit_address(jit_t *jit, ssize_t offset)
+{
+	if (offset == 0) {
+		/* mov rsi, r12 */
+		JIT_EMIT(jit, 0x4c, 0x89, 0xe6);
+	} else if ((offset >= INT32_MIN) && (offset <= INT32_MAX)) {
+		/* lea rsi, [r12 + offset] */
+		JIT_EMIT(jit, 0x49, 0x8d, 0xb4, 0x24);
+		jit_imm32(jit, offset);
+	} else {
+		/* mov rsi, offset; add rsi, r12 */
+		JIT_EMIT(jit, 0x48, 0xbe);
+		jit_imm64(jit, offset);
+		JIT_EMIT(jit, 0x4c, 0x01, 0xe6);
+	}
+}
+
+/** Emit loading of the data cell at RSI to AL
+ *
+ * The data cells beyond the allocated data memory are zero.
+ *
+ * @param jit Native code being generated.
+ *
+ */
+static void jit_load(jit_t *jit)
+{
+	if (!jit->checked) {
+		/* movzx eax, byte [rbx + rsi] */
+		JIT_EMIT(jit, 0x0f, 0xb6, 0x04, 0x33);
+		return;
+	}
+	
+	/*
+	 * xor eax, eax; lea rdx, [rsi + rbp]; cmp rdx, r13; jae +4;
+	 * movzx eax, byte [rbx + rsi]
+	 */
+	JIT_EMIT(jit, 0x31, 0xc0, 0x48, 0x8d, 0x14, 0x2e, 0x4c, 0x39, 0xea,
+	    0x73, 0x04, 0x0f, 0xb6, 0x04, 0x33);
+}
+
+/** Emit making sure the data cell at RSI is allocated
+ *
+ * Nothing is emitted if the data cell accesses are not
+ * checked.
+ *
+ * @param jit   Native code being generated.
+ * @param bound Position of the bound stub.
+ *
+ */
+static void jit_bound(jit_t *jit, size_t bound)
+{
+	if (!jit->checked)
+		return;
+	
+	/* lea rax, [rsi + rbp]; cmp rax, r13; jb +5; call bound */
+	JIT_EMIT(jit, 0x48, 0x8d, 0x04, 0x2e, 0x4c, 0x39, 0xe8, 0x72, 0x05, 0xe8);
+	jit_rel32(jit, bound);
+}
+
+/** Output the data cell from the native code
+ *
+ * @param vm  Virtual machine.
+ * @param val Value of the data cell.
+ *
+ */
+static void jit_output(ichiglyph_vm_t *vm, uint8_t val)
+{
+	output_put(vm, val);
+}
+
+/** Accept the data cell from the native code
+ *
+ * @param vm Virtual machine.
+ *
+ * @return Input value or EOF.
+ *
+ */
+static int jit_accept(ichiglyph_vm_t *vm)
+{
+	return input_get(vm);
+}
+
+/** Copy the input to the output from the native code
+ *
+ * @param vm    Virtual machine.
+ * @param val   Value of the data cell.
+ * @param first Whether the data cell is output before accepting.
+ *
+ * @return 0 or EOF.
+ *
+ */
+static int jit_cat(ichiglyph_vm_t *vm, uint8_t val, bool first)
+{
+	return input_cat(vm, val, first);
+}
+
+/** Count a compiled instruction from the native code
+ *
+ * @param vm   Virtual machine.
+ * @param code Compiled instruction.
+ * @param dp   Data memory pointer.
+ *
+ */
+static void jit_count(ichiglyph_vm_t *vm, const code_t *code, ssize_t dp)
+{
+	counters_count(&vm->counters, code, dp);
+}
+
+/** Count an addressed data cell from the native code
+ *
+ * @param vm Virtual machine.
+ * @param dp Data memory pointer of the data cell.
+ *
+ */
+static void jit_touch(ichiglyph_vm_t *vm, ssize_t dp)
+{
+	counters_touch(&vm->counters, dp);
+}
+
+/** Lock protecting the perf output */
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Perf map of the process (NULL if not open) */
+static FILE *perf_map = NULL;
+
+/** Jitdump file of the process (-1 if not open) */
+static int perf_dump = -1;
+
+/** Index of the next native code in the jitdump file */
+static uint64_t perf_index = 0;
+
+/** Get the timestamp of the perf output
+ *
+ * @return Monotonic time in nanoseconds (as expected by
+ *         perf record -k mono).
+ *
+ */
+static uint64_t perf_timestamp(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/** Open the perf output of the process
+ *
+ * The perf map is /tmp/perf-<pid>.map and the jitdump file is
+ * /tmp/jit-<pid>.dump. The jitdump file is mapped executable,
+ * thus perf record notices it and perf inject can find it.
+ * The perf output is opened just once (subsequent failures
+ * are silently ignored). Called with the perf lock held.
+ *
+ * @param perf Perf output (ichiglyph_perf_t flags).
+ *
+ */
+static void perf_open(unsigned int perf)
+{
+	static unsigned int attempted = 0;
+	char path[64];
+	
+	if (((perf & ICHIGLYPH_PERF_MAP) != 0) &&
+	    ((attempted & ICHIGLYPH_PERF_MAP) == 0)) {
+		attempted |= ICHIGLYPH_PERF_MAP;
+		
+		snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int) getpid());
+		perf_map = fopen(path, "a");
+	}
+	
+	if (((perf & ICHIGLYPH_PERF_JITDUMP) != 0) &&
+	    ((attempted & ICHIGLYPH_PERF_JITDUMP) == 0)) {
+		attempted |= ICHIGLYPH_PERF_JITDUMP;
+		
+		snprintf(path, sizeof(path), "/tmp/jit-%d.dump", (int) getpid());
+		int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+		if (fd < 0)
+			return;
+		
+		jitdump_header_t header;
+		memset(&header, 0, sizeof(header));
+		header.magic = JITDUMP_MAGIC;
+		header.version = JITDUMP_VERSION;
+		header.total_size = sizeof(header);
+		header.elf_mach = JITDUMP_MACHINE;
+		header.pid = getpid();
+		header.timestamp = perf_timestamp();
+		
+		void *marker = mmap(NULL, sysconf(_SC_PAGESIZE),
+		    PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+		
+		if ((write(fd, &header, sizeof(header)) != sizeof(header)) ||
+		    (marker == MAP_FAILED)) {
+			close(fd);
+			return;
+		}
+		
+		perf_dump = fd;
+	}
+}
+
+/** Write a region of native code to the perf output
+ *
+ * Called with the perf lock held.
+ *
+ * @param perf Perf output (ichiglyph_perf_t flags).
+ * @param code Native code.
+ * @param size Size of the native code.
+ * @param name Name of the native code.
+ *
+ */
+static void perf_region(unsigned int perf, const uint8_t *code, size_t size,
+    const char *name)
+{
+	if (size == 0)
+		return;
+	
+	if (((perf & ICHIGLYPH_PERF_MAP) != 0) && (perf_map != NULL))
+		fprintf(perf_map, "%" PRIxPTR " %zx %s\n", (uintptr_t) code, size,
+		    name);
+	
+	if (((perf & ICHIGLYPH_PERF_JITDUMP) != 0) && (perf_dump >= 0)) {
+		size_t length = strlen(name) + 1;
+		
+		jitdump_load_t load;
+		load.id = JITDUMP_CODE_LOAD;
+		load.total_size = sizeof(load) + length + size;
+		load.timestamp = perf_timestamp();
+		load.pid = getpid();
+		load.tid = syscall(SYS_gettid);
+		load.vma = (uintptr_t) code;
+		load.code_addr = (uintptr_t) code;
+		load.code_size = size;
+		load.code_index = perf_index++;
+		
+		struct iovec parts[3] = {
+			{ .iov_base = &load, .iov_len = sizeof(load) },
+			{ .iov_base = (void *) name, .iov_len = length },
+			{ .iov_base = (void *) code, .iov_len = size }
+		};
+		
+		(void) writev(perf_dump, parts, 3);
+	}
+}
+
+/** Write the native code of a program to the perf output
+ *
+ * The native code is split into regions without nesting, each
+ * of them covering the native code of the compiled instructions
+ * within the same innermost loop. The regions are named by the
+ * serial number of the program, the source offsets of the loop
+ * and its nesting depth, thus the samples of perf are attributed
+ * to the loops of the program.
+ *
+ * @param jit     Native code.
+ * @param program Compiled program.
+ * @param native  Position of the native code of each compiled
+ *                instruction (and the end of the native code).
+ * @param first   First compiled instruction of the native code.
+ * @param last    Compiled instruction following the native code.
+ *
+ */
+static void jit_perf(jit_t *jit, const ichiglyph_program_t *program,
+    const size_t *native, size_t first, size_t last)
+{
+	const code_t *code = program->code;
+	size_t opcode_size = program->language->opcode_size;
+	
+	/*
+	 * The innermost loop of each region is identified by its
+	 * CODE_JZ instruction (SIZE_MAX for the top level).
+	 */
+	size_t *stack = (size_t *) malloc((program->code_size + 1) * sizeof(size_t));
+	if (stack == NULL)
+		return;
+	
+	/*
+	 * The native code of a loop starts within the loop.
+	 */
+	size_t depth = 0;
+	stack[0] = SIZE_MAX;
+	
+	for (size_t ip = 0; ip < first; ip++) {
+		if (code[ip].op == CODE_JZ)
+			stack[++depth] = ip;
+		else if (code[ip].op == CODE_JNZ)
+			depth--;
+	}
+	
+	pthread_mutex_lock(&perf_lock);
+	perf_open(jit->perf);
+	
+	char name[128];
+	if (first == 0)
+		snprintf(name, sizeof(name), "ichiglyph#%" PRIu64 " entry",
+		    program->serial);
+	else
+		snprintf(name, sizeof(name), "ichiglyph#%" PRIu64
+		    " loop %zu-%zu entry", program->serial,
+		    (size_t) code[first - 1].offset * opcode_size,
+		    (size_t) code[last - 1].offset * opcode_size);
+	
+	perf_region(jit->perf, jit->buffer, native[first], name);
+	
+	size_t start = first;
+	
+	for (size_t ip = first; ip <= last; ip++) {
+		/*
+		 * A region ends before each CODE_JZ and after each
+		 * CODE_JNZ (and at the end of the native code).
+		 */
+		bool end = (ip == last) || (code[ip].op == CODE_JZ) ||
+		    ((ip > first) && (code[ip - 1].op == CODE_JNZ));
+		if (!end)
+			continue;
+		
+		if (ip > start) {
+			size_t loop = stack[depth];
+			
+			if (loop == SIZE_MAX)
+				snprintf(name, sizeof(name), "ichiglyph#%" PRIu64
+				    " top level", program->serial);
+			else
+				snprintf(name, sizeof(name), "ichiglyph#%" PRIu64
+				    " loop %zu-%zu depth %zu", program->serial,
+				    (size_t) code[loop].offset * opcode_size,
+				    (size_t) code[code[loop].target].offset * opcode_size,
+				    depth);
+			
+			perf_region(jit->perf, jit->buffer + native[start],
+			    native[ip] - native[start], name);
+		}
+		
+		if ((ip > first) && (code[ip - 1].op == CODE_JNZ))
+			depth--;
+		
+		if ((ip < last) && (code[ip].op == CODE_JZ))
+			stack[++depth] = ip;
+		
+		start = ip;
+	}
+	
+	if (perf_map != NULL)
+		fflush(perf_map);
+	
+	pthread_mutex_unlock(&perf_lock);
+	free(stack);
+}
+
+/** Compile code to native code
+ *
+ * Compile the code to x86-64 native code. Each compiled
+ * instruction is translated into a short template of native
+ * instructions, the jumps are translated into native
+ * conditional jumps and the input/output is performed by
+ * calling back to C functions.
+ *
+ * The native code is a function (jit_entry_t) taking the
+ * virtual machine and the data pointer as its arguments and
+ * returning 0 on normal termination or a non-zero value on
+ * an out-of-memory condition (or when the budget has been
+ * exhausted). The native code keeps the virtual machine in
+ * R14, the data cell at the origin in RBX, the number of the
+ * allocated data cells left of the origin in RBP, the number
+ * of the allocated data cells in R13, the data pointer in R12
+ * (stored back on return), the stack pointer for bailing out
+ * in R15 and the address of the data pointer on the top of
+ * the stack.
+ *
+ * Either the entire code or the body of a single loop (with its
+ * nested loops) is compiled. The native code of a loop body is
+ * entered in the middle of the execution after the loop has
+ * been entered (i.e. right after its CODE_JZ instruction) and it
+ * returns ENGINE_CONTINUE after leaving the loop (i.e. right
+ * after its CODE_JNZ instruction).
+ *
+ * The data cells of the virtual data memory are accessed
+ * without any checks. The budget is charged only if it is
+ * limited and the compiled instructions are counted (by calling
+ * back to C functions) only if the counting has been set.
+ * Optionally, the native code is written to the perf output.
+ *
+ * @param program Compiled program.
+ * @param vm      Virtual machine.
+ * @param jit     Native code (set only on success).
+ * @param first   First compiled instruction (0 or the instruction
+ *                following a CODE_JZ instruction).
+ * @param last    Compiled instruction following the native code
+ *                (the size of the code or the instruction
+ *                following the matching CODE_JNZ instruction).
+ *
+ * @return 0 if the native code was generated.
+ * @return Non-zero value if the native code cannot be generated.
+ *
+ */
+static int jit_compile(const ichiglyph_program_t *program, ichiglyph_vm_t *vm,
+    jit_t *jit, size_t first, size_t last)
+{
+	code_t *code = program->code;
+	size_t code_size = program->code_size;
+	
+	jit->checked = (vm->data.guard == 0);
+	jit->budget = (vm->limit != UINT64_MAX);
+	jit->counting = vm->counting;
+	jit->perf = vm->perf;
+	
+	size_t instruction_size = JIT_INSTRUCTION_SIZE +
+	    (jit->counting ? JIT_COUNT_SIZE : 0);
+	
+	jit->size = JIT_PREAMBLE_SIZE + (last - first) * instruction_size;
+	jit->pos = 0;
+	jit->buffer = (uint8_t *) mmap(NULL, jit->size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->buffer == MAP_FAILED)
+		return -1;
+	
+	/*
+	 * Position of the native code of each compiled instruction
+	 * (and the end of the native code).
+	 */
+	size_t *native = (size_t *) malloc((code_size + 1) * sizeof(size_t));
+	if (native == NULL) {
+		munmap(jit->buffer, jit->size);
+		return -1;
+	}
+	
+	/*
+	 * Epilogue (the common exit path).
+	 */
+	size_t epilogue = jit->pos;
+	
+	/* mov rcx, [rsp]; mov [rcx], r12 */
+	JIT_EMIT(jit, 0x48, 0x8b, 0x0c, 0x24, 0x4c, 0x89, 0x21);
+	
+	/* add rsp, 8; pop r15; pop r14; pop r13; pop r12; pop rbp; pop rbx; ret */
+	JIT_EMIT(jit, 0x48, 0x83, 0xc4, 0x08, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d,
+	    0x41, 0x5c, 0x5d, 0x5b, 0xc3);
+	
+	/*
+	 * Bound stub (called with the data cell position in RSI).
+	 * It reloads the data memory registers or bails out on
+	 * an out-of-memory condition. The data memory is the first
+	 * member of the virtual machine.
+	 */
+	size_t bound = jit->pos;
+	
+	/* push rsi; mov rdi, r14 */
+	JIT_EMIT(jit, 0x56, 0x4c, 0x89, 0xf7);
+	jit_call(jit, (const void *) data_bound);
+	
+	/* pop rsi; test eax, eax; jnz +13 */
+	JIT_EMIT(jit, 0x5e, 0x85, 0xc0, 0x75, 0x0d);
+	
+	/* mov rbx, [r14 + data]; mov rbp, [r14 + low]; mov r13, [r14 + size]; ret */
+	JIT_EMIT(jit, 0x49, 0x8b, 0x5e, offsetof(ichiglyph_vm_t, data.data));
+	JIT_EMIT(jit, 0x49, 0x8b, 0x6e, offsetof(ichiglyph_vm_t, data.low));
+	JIT_EMIT(jit, 0x4d, 0x8b, 0x6e, offsetof(ichiglyph_vm_t, data.size));
+	JIT_EMIT(jit, 0xc3);
+	
+	/* mov rsp, r15; mov eax, -1; jmp epilogue */
+	JIT_EMIT(jit, 0x4c, 0x89, 0xfc, 0xb8, 0xff, 0xff, 0xff, 0xff, 0xe9);
+	jit_rel32(jit, epilogue);
+	
+	/*
+	 * Budget stub (jumped to when the budget has been exhausted).
+	 */
+	size_t exhausted = jit->pos;
+	
+	/* mov eax, ENGINE_BUDGET; jmp epilogue */
+	JIT_EMIT(jit, 0xb8);
+	jit_imm32(jit, ENGINE_BUDGET);
+	JIT_EMIT(jit, 0xe9);
+	jit_rel32(jit, epilogue);
+	
+	/*
+	 * Prologue (the entry point).
+	 */
+	size_t prologue = jit->pos;
+	
+	/* push rbx; push rbp; push r12; push r13; push r14; push r15; sub rsp, 8 */
+	JIT_EMIT(jit, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57,
+	    0x48, 0x83, 0xec, 0x08);
+	
+	/* mov [rsp], rsi; mov r14, rdi; mov r15, rsp; mov r12, [rsi] */
+	JIT_EMIT(jit, 0x48, 0x89, 0x34, 0x24, 0x49, 0x89, 0xfe, 0x49, 0x89, 0xe7,
+	    0x4c, 0x8b, 0x26);
+	
+	/* mov rbx, [r14 + data]; mov rbp, [r14 + low]; mov r13, [r14 + size] */
+	JIT_EMIT(jit, 0x49, 0x8b, 0x5e, offsetof(ichiglyph_vm_t, data.data));
+	JIT_EMIT(jit, 0x49, 0x8b, 0x6e, offsetof(ichiglyph_vm_t, data.low));
+	JIT_EMIT(jit, 0x4d, 0x8b, 0x6e, offsetof(ichiglyph_vm_t, data.size));
+	
+	assert(jit->pos <= JIT_PREAMBLE_SIZE);
+	
+	for (size_t ip = first; ip < last; ip++) {
+		native[ip] = jit->pos;
+		size_t skip;
+		
+		if (jit->counting) {
+			/* mov rdi, r14; mov rsi, code; mov rdx, r12 */
+			JIT_EMIT(jit, 0x4c, 0x89, 0xf7, 0x48, 0xbe);
+			jit_imm64(jit, (uint64_t) (uintptr_t) &code[ip]);
+			JIT_EMIT(jit, 0x4c, 0x89, 0xe2);
+			jit_call(jit, (const void *) jit_count);
+		}
+		
+		switch (code[ip].op) {
+		case CODE_MOVE:
+			if ((code[ip].arg >= INT32_MIN) && (code[ip].arg <= INT32_MAX)) {
+				/* add r12, arg */
+				JIT_EMIT(jit, 0x49, 0x81, 0xc4);
+				jit_imm32(jit, code[ip].arg);
+			} else {
+				/* mov rax, arg; add r12, rax */
+				JIT_EMIT(jit, 0x48, 0xb8);
+				jit_imm64(jit, code[ip].arg);
+				JIT_EMIT(jit, 0x49, 0x01, 0xc4);
+			}
+			
+			break;
+		case CODE_ADD:
+			jit_address(jit, code[ip].offset);
+			jit_bound(jit, bound);
+			
+			/* add byte [rbx + rsi], arg */
+			JIT_EMIT(jit, 0x80, 0x04, 0x33, code[ip].arg);
+			break;
+		case CODE_SET:
+			jit_address(jit, code[ip].offset);
+			jit_bound(jit, bound);
+			
+			/* mov byte [rbx + rsi], arg */
+			JIT_EMIT(jit, 0xc6, 0x04, 0x33, code[ip].arg);
+			break;
+		case CODE_MUL:
+			jit_address(jit, 0);
+			jit_load(jit);
+			
+			/* test al, al; jz skip */
+			JIT_EMIT(jit, 0x84, 0xc0, 0x74, 0x00);
+			skip = jit->pos;
+			
+			jit_address(jit, code[ip].offset);
+			jit_bound(jit, bound);
+			
+			/* movzx eax, byte [rbx + r12]; imul eax, eax, arg */
+			JIT_EMIT(jit, 0x42, 0x0f, 0xb6, 0x04, 0x23, 0x69, 0xc0);
+			jit_imm32(jit, code[ip].arg);
+			
+			/* add byte [rbx + rsi], al */
+			JIT_EMIT(jit, 0x00, 0x04, 0x33);
+			
+			jit->buffer[skip - 1] = jit->pos - skip;
+			break;
+		case CODE_SCAN:
+			/* mov rdi, r14; mov rsi, r12; mov rdx, arg */
+			JIT_EMIT(jit, 0x4c, 0x89, 0xf7, 0x4c, 0x89, 0xe6, 0x48, 0xba);
+			jit_imm64(jit, code[ip].arg);
+			jit_call(jit, (const void *) data_scan);
+			
+			/* mov r12, rax */
+			JIT_EMIT(jit, 0x49, 0x89, 0xc4);
+			
+			if (jit->counting) {
+				/* mov rdi, r14; mov rsi, r12 */
+				JIT_EMIT(jit, 0x4c, 0x89, 0xf7, 0x4c, 0x89, 0xe6);
+				jit_call(jit, (const void *) jit_touch);
+			}
+			
+			break;
+		case CODE_OUTPUT:
+			jit_address(jit, code[ip].offset);
+			jit_load(jit);
+			
+			/* mov esi, eax; mov rdi, r14 */
+			JIT_EMIT(jit, 0x89, 0xc6, 0x4c, 0x89, 0xf7);
+			jit_call(jit, (const void *) jit_output);
+			break;
+		case CODE_ACCEPT:
+			/*
+			 * The data cell is allocated in advance, thus
+			 * the input value does not need to be preserved
+			 * across the bound stub.
+			 */
+			jit_address(jit, code[ip].offset);
+			jit_bound(jit, bound);
+			
+			/* mov rdi, r14 */
+			JIT_EMIT(jit, 0x4c, 0x89, 0xf7);
+			jit_call(jit, (const void *) jit_accept);
+			
+			/* cmp eax, -1; jne +7; xor eax, eax; jmp epilogue */
+			JIT_EMIT(jit, 0x83, 0xf8, 0xff, 0x75, 0x07, 0x31, 0xc0, 0xe9);
+			jit_rel32(jit, epilogue);
+			jit_address(jit, code[ip].offset);
+			
+			/* mov byte [rbx + rsi], al */
+			JIT_EMIT(jit, 0x88, 0x04, 0x33);
+			break;
+		case CODE_CAT:
+			/*
+			 * A non-zero data cell is always allocated.
+			 */
+			jit_address(jit, 0);
+			jit_load(jit);
+			
+			/* test al, al; jz skip */
+			JIT_EMIT(jit, 0x84, 0xc0, 0x74, 0x00);
+			skip = jit->pos;
+			
+			/* mov esi, eax; mov edx, arg; mov rdi, r14 */
+			JIT_EMIT(jit, 0x89, 0xc6, 0xba);
+			jit_imm32(jit, code[ip].arg);
+			JIT_EMIT(jit, 0x4c, 0x89, 0xf7);
+			jit_call(jit, (const void *) jit_cat);
+			
+			/* cmp eax, -1; jne +7; xor eax, eax; jmp epilogue */
+			JIT_EMIT(jit, 0x83, 0xf8, 0xff, 0x75, 0x07, 0x31, 0xc0, 0xe9);
+			jit_rel32(jit, epilogue);
+			
+			/* mov byte [rbx + r12], 0 */
+			JIT_EMIT(jit, 0x42, 0xc6, 0x04, 0x23, 0x00);
+			
+			jit->buffer[skip - 1] = jit->pos - skip;
+			break;
+		case CODE_JZ:
+		case CODE_JNZ:
+			if (jit->budget) {
+				/*
+				 * cmp qword [r14 + budget], arg; jb exhausted;
+				 * sub qword [r14 + budget], arg
+				 */
+				JIT_EMIT(jit, 0x49, 0x81, 0x7e,
+				    offsetof(ichiglyph_vm_t, budget));
+				jit_imm32(jit, code[ip].arg);
+				JIT_EMIT(jit, 0x0f, 0x82);
+				jit_rel32(jit, exhausted);
+				JIT_EMIT(jit, 0x49, 0x81, 0x6e,
+				    offsetof(ichiglyph_vm_t, budget));
+				jit_imm32(jit, code[ip].arg);
+			}
+			
+			jit_address(jit, 0);
+			jit_load(jit);
+			
+			/* test al, al; jz/jnz target */
+			JIT_EMIT(jit, 0x84, 0xc0, 0x0f,
+			    (code[ip].op == CODE_JZ) ? 0x84 : 0x85);
+			
+			/*
+			 * The displacement of the forward jumps is
+			 * fixed up once the target is generated.
+			 */
+			jit_imm32(jit, 0);
+			break;
+		case CODE_HALT:
+			/* xor eax, eax; jmp epilogue */
+			JIT_EMIT(jit, 0x31, 0xc0, 0xe9);
+			jit_rel32(jit, epilogue);
+			break;
+		}
+		
+		assert(jit->pos - native[ip] <= instruction_size);
+	}
+	
+	native[last] = jit->pos;
+	
+	/*
+	 * Leaving the loop (the native code of the entire code ends
+	 * with CODE_HALT).
+	 */
+	if (last < code_size) {
+		/* mov eax, ENGINE_CONTINUE; jmp epilogue */
+		JIT_EMIT(jit, 0xb8);
+		jit_imm32(jit, ENGINE_CONTINUE);
+		JIT_EMIT(jit, 0xe9);
+		jit_rel32(jit, epilogue);
+	}
+	
+	/*
+	 * Fix up the jumps. They target the compiled instruction
+	 * following the matching jump.
+	 */
+	for (size_t ip = first; ip < last; ip++) {
+		if ((code[ip].op == CODE_JZ) || (code[ip].op == CODE_JNZ)) {
+			jit->pos = native[ip + 1] - sizeof(int32_t);
+			jit_rel32(jit, native[code[ip].target + 1]);
+		}
+	}
+	
+	jit->pos = prologue;
+	
+	if (mprotect(jit->buffer, jit->size, PROT_READ | PROT_EXEC) != 0) {
+		free(native);
+		munmap(jit->buffer, jit->size);
+		return -1;
+	}
+	
+	if (jit->perf != ICHIGLYPH_PERF_NONE)
+		jit_perf(jit, program, native, first, last);
+	
+	free(native);
+	return 0;
+}
+
+/** Release the native code of the last program
+ *
+ * @param vm Virtual machine.
+ *
+ */
+static void jit_release(ichiglyph_vm_t *vm)
+{
+	if (vm->jit_serial != 0) {
+		munmap(vm->jit.buffer, vm->jit.size);
+		vm->jit_serial = 0;
+	}
+}
+
+/** Execute compiled code using the JIT engine
+ *
+ * Compile the code to native code and execute it. The native
+ * code of the last program is kept by the virtual machine and
+ * reused by the subsequent executions of the same program (as
+ * long as the data memory and the budget are of the same kind).
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ *
+ * @return 0 if the execution terminated normally.
+ * @return ENGINE_BUDGET if the budget has been exhausted.
+ * @return ENGINE_UNAVAILABLE if the native code cannot be
+ *         generated.
+ * @return Other non-zero value if the execution cannot continue
+ *         (out-of-memory condition).
+ *
+ */
+static int execute_jit(ichiglyph_vm_t *vm, const ichiglyph_program_t *program)
+{
+	if ((vm->jit_serial != program->serial) ||
+	    (vm->jit.checked != (vm->data.guard == 0)) ||
+	    (vm->jit.budget != (vm->limit != UINT64_MAX)) ||
+	    (vm->jit.counting != vm->counting) ||
+	    (vm->jit.perf != vm->perf)) {
+		jit_release(vm);
+		
+		int ret = jit_compile(program, vm, &vm->jit, 0, program->code_size);
+		if (ret != 0)
+			return ENGINE_UNAVAILABLE;
+		
+		vm->jit_serial = program->serial;
+	}
+	
+	ssize_t dp = 0;
+	jit_entry_t entry = (jit_entry_t) (vm->jit.buffer + vm->jit.pos);
+	return entry(vm, &dp);
+}
+
+/** Release the tiered execution
+ *
+ * @param tier Tiered execution.
+ *
+ */
+static void tier_release(tier_t *tier)
+{
+	if (tier->loops != NULL) {
+		for (size_t i = 0; i < tier->size; i++) {
+			if (tier->loops[i].buffer != NULL)
+				munmap(tier->loops[i].buffer, tier->loops[i].size);
+		}
+	}
+	
+	free(tier->counts);
+	free(tier->loops);
+	
+	tier->serial = 0;
+	tier->size = 0;
+	tier->counts = NULL;
+	tier->loops = NULL;
+}
+
+/** Prepare the tiered execution
+ *
+ * The back edge counters and the native code of the loops
+ * are kept if the program has been executed last.
+ *
+ * @param tier    Tiered execution.
+ * @param program Compiled program to be executed.
+ *
+ * @return 0 if the tiered execution has been prepared.
+ * @return Non-zero value on an out-of-memory condition.
+ *
+ */
+static int tier_prepare(tier_t *tier, const ichiglyph_program_t *program)
+{
+	if (tier->serial == program->serial)
+		return 0;
+	
+	tier_release(tier);
+	
+	size_t size = program->code_size;
+	tier->counts = (uint32_t *) calloc(size, sizeof(uint32_t));
+	tier->loops = (jit_t *) calloc(size, sizeof(jit_t));
+	
+	if ((tier->counts == NULL) || (tier->loops == NULL)) {
+		tier_release(tier);
+		return -1;
+	}
+	
+	tier->serial = program->serial;
+	tier->size = size;
+	return 0;
+}
+
+/** Enter the native code of a hot loop
+ *
+ * The body of the loop (with its nested loops) is compiled to
+ * native code on demand (or again if the data memory, the
+ * budget or the counting is of a different kind). The native code continues
+ * the current iteration of the loop.
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ * @param tier    Tiered execution.
+ * @param loop    CODE_JZ instruction of the loop.
+ * @param dp      Data pointer (updated by the native code).
+ *
+ * @return ENGINE_CONTINUE if the loop has been left.
+ * @return ENGINE_UNAVAILABLE if the native code cannot be
+ *         generated.
+ * @return Other value if the execution terminated (see
+ *         execute_jit()).
+ *
+ */
+static int tier_enter(ichiglyph_vm_t *vm, const ichiglyph_program_t *program,
+    tier_t *tier, size_t loop, ssize_t *dp)
+{
+	jit_t *jit = &tier->loops[loop];
+	
+	if ((jit->buffer != NULL) &&
+	    ((jit->checked != (vm->data.guard == 0)) ||
+	    (jit->budget != (vm->limit != UINT64_MAX)) ||
+	    (jit->counting != vm->counting) ||
+	    (jit->perf != vm->perf))) {
+		munmap(jit->buffer, jit->size);
+		jit->buffer = NULL;
+	}
+	
+	if (jit->buffer == NULL) {
+		int ret = jit_compile(program, vm, jit, loop + 1,
+		    program->code[loop].target + 1);
+		if (ret != 0) {
+			jit->buffer = NULL;
+			return ENGINE_UNAVAILABLE;
+		}
+	}
+	
+	jit_entry_t entry = (jit_entry_t) (jit->buffer + jit->pos);
+	return entry(vm, dp);
+}
+
+#else
+
+static void jit_release(ichiglyph_vm_t *vm)
+{
+}
+
+static int execute_jit(ichiglyph_vm_t *vm, const ichiglyph_program_t *program)
+{
+	return ENGINE_UNAVAILABLE;
+}
+
+static void tier_release(tier_t *tier)
+{
+}
+
+static int tier_prepare(tier_t *tier, const ichiglyph_program_t *program)
+{
+	return ENGINE_UNAVAILABLE;
+}
+
+static int tier_enter(ichiglyph_vm_t *vm, const ichiglyph_program_t *program,
+    tier_t *tier, size_t loop, ssize_t *dp)
+{
+	return ENGINE_UNAVAILABLE;
+}
+
+#endif
+
+/** Release the execution profile
+ *
+ * @param profile Execution profile.
+ *
+ */
+static void profile_release(profile_t *profile)
+{
+	free(profile->counts);
+	free(profile->trips);
+	free(profile->histogram);
+	
+	profile->serial = 0;
+	profile->size = 0;
+	profile->counts = NULL;
+	profile->trips = NULL;
+	profile->histogram = NULL;
+}
+
+/** Prepare the execution profile
+ *
+ * The profile of the previous execution is discarded.
+ *
+ * @param profile Execution profile.
+ * @param program Compiled program to be profiled.
+ *
+ * @return 0 if the profile has been prepared.
+ * @return Non-zero value on an out-of-memory condition.
+ *
+ */
+static int profile_prepare(profile_t *profile,
+    const ichiglyph_program_t *program)
+{
+	profile_release(profile);
+	
+	size_t size = program->code_size;
+	profile->counts = (uint64_t *) calloc(size, sizeof(uint64_t));
+	profile->trips = (uint64_t *) calloc(size, sizeof(uint64_t));
+	profile->histogram = (uint64_t (*)[PROFILE_BUCKETS])
+	    calloc(size, sizeof(*profile->histogram));
+	
+	if ((profile->counts == NULL) || (profile->trips == NULL) ||
+	    (profile->histogram == NULL)) {
+		profile_release(profile);
+		return -1;
+	}
+	
+	profile->serial = program->serial;
+	profile->size = size;
+	return 0;
+}
+
+/** Execute compiled program
+ *
+ * Execute the compiled program using the engine of the virtual
+ * machine. A write to the guard areas of the virtual data memory
+ * is treated as an out-of-memory condition.
+ *
+ * If the counting has been set, each engine counts the compiled
+ * instructions it dispatches (thus the counters of all engines
+ * are the same for the same execution).
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ *
+ * @return 0 if the execution terminated normally.
+ * @return ENGINE_BUDGET if the budget has been exhausted.
+ * @return Other non-zero value if the execution cannot continue
+ *         (out-of-memory condition).
+ *
+ */
+static int execute(ichiglyph_vm_t *vm, const ichiglyph_program_t *program)
+{
+	/*
+	 * The guard areas watched by an enclosing execution (e.g.
+	 * from an input or output callback) are restored afterwards.
+	 */
+	data_t *fault_data = data_fault_data;
+	sigjmp_buf *fault_context = data_fault_context;
+	sigjmp_buf context;
+	
+	if (vm->data.guard != 0) {
+		if (sigsetjmp(context, 1) != 0) {
+			data_fault_data = fault_data;
+			data_fault_context = fault_context;
+			return -1;
+		}
+		
+		data_fault_data = &vm->data;
+		data_fault_context = &context;
+	}
+	
+	counters_t *counters = (vm->counting) ? &vm->counters : NULL;
+	int ret = 0;
+	
+	switch (vm->engine) {
+	case ICHIGLYPH_ENGINE_SWITCH:
+		if (counters != NULL)
+			ret = execute_switch_hooked(vm, program->code, NULL,
+			    counters);
+		else
+			ret = execute_switch(vm, program->code);
+		
+		break;
+	case ICHIGLYPH_ENGINE_PROFILE:
+		ret = profile_prepare(&vm->profile, program);
+		if (ret == 0)
+			ret = execute_switch_hooked(vm, program->code,
+			    &vm->profile, counters);
+		
+		break;
+	case ICHIGLYPH_ENGINE_JIT:
+		ret = execute_jit(vm, program);
+		if (ret != ENGINE_UNAVAILABLE)
+			break;
+		
+		/*
+		 * Fall back to the interpreter if the native code
+		 * cannot be generated.
+		 */
+		ret = execute_threaded(vm, program, NULL);
+		break;
+	case ICHIGLYPH_ENGINE_TIERED:
+		ret = tier_prepare(&vm->tier, program);
+		if (ret == 0) {
+			ret = execute_threaded(vm, program, &vm->tier);
+			break;
+		}
+		
+		/*
+		 * Fall back to the plain interpreter if the tiered
+		 * execution is unavailable.
+		 */
+		ret = execute_threaded(vm, program, NULL);
+		break;
+	case ICHIGLYPH_ENGINE_THREADED:
+		ret = execute_threaded(vm, program, NULL);
+		break;
+	}
+	
+	data_fault_data = fault_data;
+	data_fault_context = fault_context;
+	return ret;
+}
+
+/** Flush the output buffer of a lane
+ *
+ * @param lane Lane.
+ *
+ */
+static void lane_flush(lane_t *lane)
+{
+	if ((lane->output_pos > 0) && (lane->write != NULL))
+		lane->write(lane->write_arg, lane->output_buffer, lane->output_pos);
+	
+	lane->output_pos = 0;
+}
+
+/** Output a byte of a lane
+ *
+ * @param lane Lane.
+ * @param val  Byte to output.
+ *
+ */
+static inline void lane_put(lane_t *lane, uint8_t val)
+{
+	lane->output_buffer[lane->output_pos++] = val;
+	
+	if (lane->output_pos >= LANE_BUFFER_SIZE)
+		lane_flush(lane);
+}
+
+/** Output bytes of a lane
+ *
+ * @param lane  Lane.
+ * @param bytes Bytes to output.
+ * @param count Number of bytes to output.
+ *
+ */
+static void lane_write(lane_t *lane, const uint8_t *bytes, size_t count)
+{
+	if (lane->output_pos + count < LANE_BUFFER_SIZE) {
+		memcpy(lane->output_buffer + lane->output_pos, bytes, count);
+		lane->output_pos += count;
+		return;
+	}
+	
+	lane_flush(lane);
+	
+	if ((count > 0) && (lane->write != NULL))
+		lane->write(lane->write_arg, bytes, count);
+}
+
+/** Copy the input of a lane to its output
+ *
+ * Execute CODE_CAT on a non-zero data cell of a lane (see
+ * input_cat()).
+ *
+ * @param lane  Lane.
+ * @param val   Value of the data cell.
+ * @param first Whether the data cell is output before accepting.
+ *
+ * @return 0 if a zero byte has been copied.
+ * @return EOF if the end of the input has been reached.
+ *
+ */
+static int lane_cat(lane_t *lane, uint8_t val, bool first)
+{
+	if (first)
+		lane_put(lane, val);
+	
+	const uint8_t *start = lane->input + lane->input_pos;
+	size_t count = lane->input_size - lane->input_pos;
+	const uint8_t *zero = (count > 0) ?
+	    (const uint8_t *) memchr(start, 0, count) : NULL;
+	
+	if (zero == NULL) {
+		lane_write(lane, start, count);
+		lane->input_pos += count;
+		return EOF;
+	}
+	
+	count = zero - start;
+	lane_write(lane, start, first ? count : count + 1);
+	lane->input_pos += count + 1;
+	return 0;
+}
+
+/** Make sure the lockstep data cells are allocated
+ *
+ * Make sure the data cells within the reach of the data
+ * pointer are allocated (growing the data memory
+ * geometrically in the respective direction).
+ *
+ * @param lockstep Lockstep execution.
+ * @param dp       Data pointer.
+ * @param reach    Maximal data cell offset relative to the
+ *                 data pointer.
+ *
+ * @return 0 on success.
+ * @return Non-zero value on an out-of-memory condition.
+ *
+ */
+static int lockstep_bound(lockstep_t *lockstep, ssize_t dp, size_t reach)
+{
+	ssize_t first = dp - (ssize_t) reach + (ssize_t) lockstep->low;
+	ssize_t last = dp + (ssize_t) reach + (ssize_t) lockstep->low;
+	
+	if ((first >= 0) && (last < (ssize_t) lockstep->size))
+		return 0;
+	
+	size_t low = lockstep->low;
+	size_t high = lockstep->size - lockstep->low;
+	
+	if (first < 0)
+		low += (low > (size_t) -first) ? low : (size_t) -first +
+		    LOCKSTEP_GRANULARITY;
+	
+	if (last >= (ssize_t) lockstep->size)
+		high += (high > (size_t) last + 1 - lockstep->size) ? high :
+		    (size_t) last + 1 - lockstep->size + LOCKSTEP_GRANULARITY;
+	
+	lanes_t *memory = (lanes_t *) calloc(low + high, sizeof(lanes_t));
+	if (memory == NULL)
+		return -1;
+	
+	if (lockstep->memory != NULL)
+		memcpy(memory + low - lockstep->low, lockstep->memory,
+		    lockstep->size * sizeof(lanes_t));
+	
+	free(lockstep->memory);
+	lockstep->memory = memory;
+	lockstep->data = memory + low;
+	lockstep->low = low;
+	lockstep->size = low + high;
+	return 0;
+}
+
+/** Check whether any lane is set
+ *
+ * @param mask Lanes (0xff for the set lanes).
+ *
+ * @return True if any lane is set.
+ *
+ */
+static inline bool lanes_any(lanes_t mask)
+{
+	uint64_t half[2];
+	memcpy(half, &mask, sizeof(half));
+	return (half[0] | half[1]) != 0;
+}
+
+/** Charge the budget of the active lanes
+ *
+ * The lanes that have exhausted their budget are terminated.
+ *
+ * @param lockstep Lockstep execution.
+ * @param active   Active lanes.
+ * @param live     Lanes that have not terminated.
+ * @param charge   Budget to charge.
+ *
+ */
+static void lockstep_charge(lockstep_t *lockstep, lanes_t *active,
+    lanes_t *live, uint64_t charge)
+{
+	for (size_t i = 0; i < ICHIGLYPH_LANES; i++) {
+		if ((*active)[i] == 0)
+			continue;
+		
+		lane_t *lane = &lockstep->lanes[i];
+		if (lane->budget < charge) {
+			lane->result = ICHIGLYPH_BUDGET;
+			(*active)[i] = 0;
+			(*live)[i] = 0;
+		} else
+			lane->budget -= charge;
+	}
+}
+
+/** Execute compiled code in lockstep
+ *
+ * Execute the compiled code on all lanes at once. The data
+ * cell operations are performed on the whole vectors of data
+ * cells, masked by the active lanes. A loop is entered by the
+ * lanes with a non-zero data cell and each lane leaves the
+ * loop as soon as its data cell becomes zero. The lanes that
+ * entered the loop are restored when the last lane leaves the
+ * loop. The input and output is performed lane by lane.
+ *
+ * @param lockstep Lockstep execution.
+ * @param program  Compiled program.
+ * @param live     Lanes to execute.
+ * @param limited  Whether the budget of the lanes is limited.
+ *
+ * @return 0 if the execution terminated normally.
+ * @return Non-zero value if the execution cannot continue
+ *         (out-of-memory condition).
+ *
+ */
+static int execute_lockstep(lockstep_t *lockstep,
+    const ichiglyph_program_t *program, lanes_t live, bool limited)
+{
+	code_t *code = program->code;
+	size_t reach = program->lockstep_reach;
+	lanes_t *stack = lockstep->stack;
+	size_t level = 0;
+	lanes_t active = live;
+	size_t ip = 0;
+	ssize_t dp = 0;
+	
+	if (lockstep_bound(lockstep, dp, reach) != 0)
+		return -1;
+	
+	while (true) {
+		lanes_t *cells = lockstep->data + dp;
+		lanes_t nonzero;
+		
+		switch (code[ip].op) {
+		case CODE_MOVE:
+			dp += code[ip].arg;
+			if (lockstep_bound(lockstep, dp, reach) != 0)
+				return -1;
+			
+			break;
+		case CODE_ADD:
+			cells[code[ip].offset] += (uint8_t) code[ip].arg & active;
+			break;
+		case CODE_SET:
+			cells[code[ip].offset] = (cells[code[ip].offset] & ~active) |
+			    ((uint8_t) code[ip].arg & active);
+			break;
+		case CODE_MUL:
+			cells[code[ip].offset] +=
+			    (cells[0] * (uint8_t) code[ip].arg) & active;
+			break;
+		case CODE_SCAN:
+			/* Rejected by code_lockstep() */
+			return -1;
+		case CODE_OUTPUT:
+			for (size_t i = 0; i < ICHIGLYPH_LANES; i++) {
+				if (active[i] != 0)
+					lane_put(&lockstep->lanes[i], cells[code[ip].offset][i]);
+			}
+			
+			break;
+		case CODE_ACCEPT:
+			for (size_t i = 0; i < ICHIGLYPH_LANES; i++) {
+				if (active[i] == 0)
+					continue;
+				
+				lane_t *lane = &lockstep->lanes[i];
+				if (lane->input_pos < lane->input_size)
+					cells[code[ip].offset][i] =
+					    lane->input[lane->input_pos++];
+				else {
+					active[i] = 0;
+					live[i] = 0;
+				}
+			}
+			
+			break;
+		case CODE_CAT:
+			for (size_t i = 0; i < ICHIGLYPH_LANES; i++) {
+				if ((active[i] == 0) || (cells[0][i] == 0))
+					continue;
+				
+				if (lane_cat(&lockstep->lanes[i], cells[0][i],
+				    code[ip].arg) == EOF) {
+					active[i] = 0;
+					live[i] = 0;
+				} else
+					cells[0][i] = 0;
+			}
+			
+			break;
+		case CODE_JZ:
+			if (limited)
+				lockstep_charge(lockstep, &active, &live, code[ip].arg);
+			
+			nonzero = (lanes_t) (cells[0] != 0) & active;
+			if (lanes_any(nonzero)) {
+				stack[level++] = active;
+				active = nonzero;
+			} else
+				ip = code[ip].target;
+			
+			break;
+		case CODE_JNZ:
+			if (limited)
+				lockstep_charge(lockstep, &active, &live, code[ip].arg);
+			
+			nonzero = (lanes_t) (cells[0] != 0) & active;
+			if (lanes_any(nonzero)) {
+				active = nonzero;
+				ip = code[ip].target;
+			} else
+				active = stack[--level] & live;
+			
+			break;
+		case CODE_HALT:
+			return 0;
+		}
+		
+		ip++;
+	}
+}
+
+/** Profile report being written */
+typedef struct {
+	ichiglyph_write_t write;  /**< Output callback */
+	void *arg;                /**< Argument of the output callback */
+} report_t;
+
+/** Loop of the profile report */
+typedef struct {
+	size_t forward;      /**< Position of the CODE_JZ instruction */
+	size_t start;        /**< Position of the opening bracket in the
+	                          program */
+	size_t end;          /**< Position of the closing bracket in the
+	                          program */
+	size_t parent;       /**< Enclosing loop (SIZE_MAX for the top
+	                          level) */
+	size_t depth;        /**< Nesting depth (1 for the top level) */
+	uint64_t self;       /**< Executed instructions of the loop
+	                          excluding the nested loops */
+	uint64_t inclusive;  /**< Executed instructions of the loop
+	                          including the nested loops */
+} report_loop_t;
+
+/** Attribution of the profile to the program */
+typedef struct {
+	size_t size;           /**< Number of the instructions of the
+	                            program */
+	uint64_t *costs;       /**< Executions of each instruction */
+	size_t *owners;        /**< Innermost loop of each instruction
+	                            (SIZE_MAX for the top level) */
+	size_t *lines;         /**< Source line of each instruction */
+	report_loop_t *loops;  /**< Loops in the order of the program */
+	size_t count;          /**< Number of the loops */
+	uint64_t total;        /**< Executed instructions of the program */
+} report_map_t;
+
+/** Write formatted text to the profile report
+ *
+ * @param report Profile report.
+ * @param format Format string.
+ *
+ */
+static void __attribute__((format(printf, 2, 3)))
+report_printf(report_t *report, const char *format, ...)
+{
+	char buffer[256];
+	va_list args;
+	
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	
+	if (length < 0)
+		return;
+	
+	if ((size_t) length >= sizeof(buffer))
+		length = sizeof(buffer) - 1;
+	
+	report->write(report->arg, (const uint8_t *) buffer, length);
+}
+
+/** Render a part of the program in Brainfuck
+ *
+ * The rendering is truncated to PROFILE_RENDER characters.
+ *
+ * @param program Compiled program.
+ * @param source  Program source.
+ * @param start   Position of the first instruction.
+ * @param end     Position of the last instruction.
+ * @param buffer  Buffer for the rendering (at least
+ *                PROFILE_RENDER + 4 bytes).
+ *
+ */
+static void report_render(const ichiglyph_program_t *program,
+    const uint8_t *source, size_t start, size_t end, char *buffer)
+{
+	static const char glyphs[] = {
+		[INST_DP_INC] = '>',
+		[INST_DP_DEC] = '<',
+		[INST_VAL_INC] = '+',
+		[INST_VAL_DEC] = '-',
+		[INST_VAL_OUTPUT] = '.',
+		[INST_VAL_ACCEPT] = ',',
+		[INST_JMP_FORWARD] = '[',
+		[INST_JMP_BACK] = ']'
+	};
+	
+	language_t *language = program->language;
+	size_t length = 0;
+	
+	for (size_t pos = start; pos <= end; pos++) {
+		instruction_t inst =
+		    language->decode(source + pos * language->opcode_size);
+		if (inst == INST_NOP)
+			continue;
+		
+		if (length == PROFILE_RENDER) {
+			memcpy(buffer + length, "...", 3);
+			length += 3;
+			break;
+		}
+		
+		buffer[length++] = glyphs[inst];
+	}
+	
+	buffer[length] = 0;
+}
+
+/** Release the attribution of the profile
+ *
+ * @param map Attribution of the profile.
+ *
+ */
+static void report_unmap(report_map_t *map)
+{
+	free(map->costs);
+	free(map->owners);
+	free(map->lines);
+	free(map->loops);
+}
+
+/** Attribute the profile to the program
+ *
+ * The compiled code between two consecutive jumps covers the
+ * instructions of the program between the respective brackets,
+ * thus each instruction of the program is executed as many
+ * times as the first compiled instruction following the
+ * preceding bracket (a loop replaced by an idiom counts as
+ * a single execution of its instructions).
+ *
+ * @param map     Attribution of the profile (set only on
+ *                success).
+ * @param profile Execution profile.
+ * @param program Compiled program.
+ * @param source  Program source.
+ * @param size    Size of the program source (in bytes).
+ *
+ * @return 0 if the profile has been attributed.
+ * @return Positive value if the source does not match the
+ *         compiled program.
+ * @return Negative value on an out-of-memory condition.
+ *
+ */
+static int report_map(report_map_t *map, const profile_t *profile,
+    const ichiglyph_program_t *program, const uint8_t *source, size_t size)
+{
+	const code_t *code = program->code;
+	language_t *language = program->language;
+	
+	map->size = size / language->opcode_size;
+	map->count = 0;
+	map->total = 0;
+	
+	for (size_t ip = 0; ip < program->code_size; ip++) {
+		if (code[ip].op == CODE_JZ)
+			map->count++;
+	}
+	
+	map->costs = (uint64_t *) malloc(map->size * sizeof(uint64_t));
+	map->owners = (size_t *) malloc(map->size * sizeof(size_t));
+	map->lines = (size_t *) malloc(map->size * sizeof(size_t));
+	map->loops = (report_loop_t *) malloc(map->count * sizeof(report_loop_t));
+	
+	if (((map->size > 0) && ((map->costs == NULL) ||
+	    (map->owners == NULL) || (map->lines == NULL))) ||
+	    ((map->count > 0) && (map->loops == NULL))) {
+		report_unmap(map);
+		return -1;
+	}
+	
+	size_t next = 0;
+	while ((next < program->code_size) && (code[next].op != CODE_JZ) &&
+	    (code[next].op != CODE_JNZ))
+		next++;
+	
+	uint64_t segment = profile->counts[0];
+	size_t current = SIZE_MAX;
+	size_t depth = 0;
+	size_t loops = 0;
+	size_t line = 1;
+	size_t offset = 0;
+	
+	for (size_t pos = 0; pos < map->size; pos++) {
+		for (; offset < pos * language->opcode_size; offset++) {
+			if (source[offset] == '\n')
+				line++;
+		}
+		
+		map->lines[pos] = line;
+		map->owners[pos] = current;
+		map->costs[pos] = 0;
+		
+		if ((next < program->code_size) && ((size_t) code[next].offset == pos)) {
+			map->costs[pos] = profile->counts[next];
+			
+			if (code[next].op == CODE_JZ) {
+				report_loop_t *loop = &map->loops[loops];
+				
+				loop->forward = next;
+				loop->start = pos;
+				loop->end = pos;
+				loop->parent = current;
+				loop->depth = ++depth;
+				loop->self = 0;
+				loop->inclusive = 0;
+				
+				current = loops++;
+				map->owners[pos] = current;
+			} else {
+				if (current == SIZE_MAX)
+					break;
+				
+				map->loops[current].end = pos;
+				current = map->loops[current].parent;
+				depth--;
+			}
+			
+			segment = profile->counts[next + 1];
+			
+			do {
+				next++;
+			} while ((next < program->code_size) &&
+			    (code[next].op != CODE_JZ) && (code[next].op != CODE_JNZ));
+		} else if (language->decode(source + pos * language->opcode_size) !=
+		    INST_NOP)
+			map->costs[pos] = segment;
+		
+		if (map->owners[pos] != SIZE_MAX)
+			map->loops[map->owners[pos]].self += map->costs[pos];
+		
+		map->total += map->costs[pos];
+	}
+	
+	if ((loops != map->count) || (next < program->code_size)) {
+		report_unmap(map);
+		return 1;
+	}
+	
+	/*
+	 * The nested loops follow the enclosing loop.
+	 */
+	for (size_t i = map->count; i > 0; i--) {
+		report_loop_t *loop = &map->loops[i - 1];
+		
+		loop->inclusive += loop->self;
+		if (loop->parent != SIZE_MAX)
+			map->loops[loop->parent].inclusive += loop->inclusive;
+	}
+	
+	return 0;
+}
+
+/** Compare the loops of the profile report
+ *
+ * @param a First loop.
+ * @param b Second loop.
+ *
+ * @return Order of the loops by the executed instructions
+ *         (descending) and by their position.
+ *
+ */
+static int report_compare(const void *a, const void *b)
+{
+	const report_loop_t *loop_a = *((const report_loop_t *const *) a);
+	const report_loop_t *loop_b = *((const report_loop_t *const *) b);
+	
+	if (loop_a->self != loop_b->self)
+		return (loop_a->self > loop_b->self) ? -1 : 1;
+	
+	return (loop_a->start > loop_b->start) - (loop_a->start < loop_b->start);
+}
+
+/** Write the hot loops of the profile report
+ *
+ * @param report  Profile report.
+ * @param map     Attribution of the profile.
+ * @param profile Execution profile.
+ * @param program Compiled program.
+ * @param source  Program source.
+ * @param name    Name of the program source.
+ * @param top     Maximal number of the reported loops.
+ *
+ * @return 0 if the report has been written.
+ * @return Non-zero value on an out-of-memory condition.
+ *
+ */
+static int report_text(report_t *report, const report_map_t *map,
+    const profile_t *profile, const ichiglyph_program_t *program,
+    const uint8_t *source, const char *name, size_t top)
+{
+	report_loop_t **sorted =
+	    (report_loop_t **) malloc(map->count * sizeof(report_loop_t *));
+	if ((sorted == NULL) && (map->count > 0))
+		return -1;
+	
+	for (size_t i = 0; i < map->count; i++)
+		sorted[i] = &map->loops[i];
+	
+	qsort(sorted, map->count, sizeof(report_loop_t *), report_compare);
+	
+	if (top > map->count)
+		top = map->count;
+	
+	double total = (map->total > 0) ? (double) map->total : 1.0;
+	size_t opcode_size = program->language->opcode_size;
+	
+	report_printf(report, "Profile of %s: %" PRIu64
+	    " executed instructions, %zu loops\n", name, map->total, map->count);
+	
+	if (top > 0)
+		report_printf(report, "\nHot loops (by the executed instructions "
+		    "excluding the nested loops):\n");
+	
+	for (size_t i = 0; i < top; i++) {
+		report_loop_t *loop = sorted[i];
+		uint64_t entries = profile->counts[loop->forward];
+		uint64_t iterations = profile->counts[loop->forward + 1];
+		const uint64_t *histogram = profile->histogram[loop->forward];
+		
+		report_printf(report, "\n%zu. Offset %zu-%zu (line %zu), depth %zu\n",
+		    i + 1, loop->start * opcode_size, loop->end * opcode_size,
+		    map->lines[loop->start], loop->depth);
+		report_printf(report, "   Executed: %" PRIu64 " (%.1f %%), %" PRIu64
+		    " including the nested loops (%.1f %%)\n", loop->self,
+		    100.0 * loop->self / total, loop->inclusive,
+		    100.0 * loop->inclusive / total);
+		report_printf(report, "   Entries: %" PRIu64 ", iterations: %" PRIu64
+		    " (%.1f per entry)\n", entries, iterations,
+		    (entries > 0) ? (double) iterations / entries : 0.0);
+		report_printf(report, "   Trip counts:");
+		
+		bool first = true;
+		for (size_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+			if (histogram[bucket] == 0)
+				continue;
+			
+			uint64_t low = (bucket > 0) ? (uint64_t) 1 << (bucket - 1) : 0;
+			uint64_t high = (bucket > 0) ? (low << 1) - 1 : 0;
+			
+			if (low == high)
+				report_printf(report, "%s %" PRIu64 ": %" PRIu64,
+				    first ? "" : ",", low, histogram[bucket]);
+			else
+				report_printf(report, "%s %" PRIu64 "-%" PRIu64 ": %" PRIu64,
+				    first ? "" : ",", low, high, histogram[bucket]);
+			
+			first = false;
+		}
+		
+		char rendering[PROFILE_RENDER + 4];
+		report_render(program, source, loop->start, loop->end, rendering);
+		
+		report_printf(report, "%s\n   Brainfuck: %s\n", first ? " none" : "",
+		    rendering);
+	}
+	
+	free(sorted);
+	return 0;
+}
+
+/** Write the name of a function of the callgrind profile
+ *
+ * The name is written only at the first occurrence of the
+ * function (its identifier is used subsequently).
+ *
+ * @param report  Profile report.
+ * @param map     Attribution of the profile.
+ * @param program Compiled program.
+ * @param source  Program source.
+ * @param key     Key of the line ("fn" or "cfn").
+ * @param loop    Loop (SIZE_MAX for the top level).
+ * @param named   Whether the functions have been named.
+ *
+ */
+static void report_function(report_t *report, const report_map_t *map,
+    const ichiglyph_program_t *program, const uint8_t *source,
+    const char *key, size_t loop, bool *named)
+{
+	size_t id = (loop != SIZE_MAX) ? loop + 1 : 0;
+	
+	if (named[id]) {
+		report_printf(report, "%s=(%zu)\n", key, id + 1);
+		return;
+	}
+	
+	named[id] = true;
+	
+	if (loop == SIZE_MAX) {
+		report_printf(report, "%s=(%zu) program\n", key, id + 1);
+		return;
+	}
+	
+	char rendering[PROFILE_RENDER + 4];
+	report_render(program, source, map->loops[loop].start,
+	    map->loops[loop].end, rendering);
+	
+	report_printf(report, "%s=(%zu) loop@%zu %s\n", key, id + 1,
+	    map->loops[loop].start * program->language->opcode_size, rendering);
+}
+
+/** Write the callgrind profile
+ *
+ * The top level of the program and each loop are represented
+ * as functions (the loops are called by the enclosing loops),
+ * the positions are the source byte offsets and the source lines
+ * (the Ichiglyph programs are usually a single line, thus the
+ * byte offsets keep the costs of the individual instructions).
+ *
+ * @param report  Profile report.
+ * @param map     Attribution of the profile.
+ * @param profile Execution profile.
+ * @param program Compiled program.
+ * @param source  Program source.
+ * @param name    Name of the program source.
+ *
+ * @return 0 if the report has been written.
+ * @return Non-zero value on an out-of-memory condition.
+ *
+ */
+static int report_callgrind(report_t *report, const report_map_t *map,
+    const profile_t *profile, const ichiglyph_program_t *program,
+    const uint8_t *source, const char *name)
+{
+	bool *named = (bool *) calloc(map->count + 1, sizeof(bool));
+	if (named == NULL)
+		return -1;
+	
+	report_printf(report, "# callgrind format\n");
+	report_printf(report, "version: 1\n");
+	report_printf(report, "creator: libichiglyph\n");
+	report_printf(report, "positions: instr line\n");
+	report_printf(report, "events: Instructions\n");
+	report_printf(report, "summary: %" PRIu64 "\n\n", map->total);
+	report_printf(report, "fl=(1) %s\n", name);
+	
+	for (size_t function = 0; function <= map->count; function++) {
+		size_t loop = (function > 0) ? function - 1 : SIZE_MAX;
+		size_t start = (loop != SIZE_MAX) ? map->loops[loop].start : 0;
+		size_t end = (loop != SIZE_MAX) ? map->loops[loop].end + 1 : map->size;
+		
+		report_function(report, map, program, source, "fn", loop, named);
+		
+		for (size_t pos = start; pos < end; pos++) {
+			size_t offset = pos * program->language->opcode_size;
+			
+			if (map->owners[pos] == loop) {
+				if (map->costs[pos] > 0)
+					report_printf(report, "%zu %zu %" PRIu64 "\n", offset,
+					    map->lines[pos], map->costs[pos]);
+				
+				continue;
+			}
+			
+			/*
+			 * A nested loop is called at its opening bracket.
+			 */
+			const report_loop_t *nested = &map->loops[map->owners[pos]];
+			
+			report_function(report, map, program, source, "cfn",
+			    map->owners[pos], named);
+			report_printf(report, "calls=%" PRIu64 " %zu %zu\n",
+			    profile->counts[nested->forward], offset, map->lines[pos]);
+			report_printf(report, "%zu %zu %" PRIu64 "\n", offset,
+			    map->lines[pos], nested->inclusive);
+			
+			pos = nested->end;
+		}
+		
+		report_printf(report, "\n");
+	}
+	
+	free(named);
+	return 0;
+}
+
+/** Serial number of the last compiled program */
+static uint64_t program_serial = 0;
+
+/** Compile program
+ *
+ * Compile the program source into a program that can be
+ * executed by the virtual machines. Optionally, the output of
+ * the beginning of the program that does not depend on the
+ * input (e.g. a banner) is computed just once in advance
+ * (the program is also compiled without it for the executions
+ * whose budget does not cover it).
+ *
+ * @param language  Language of the program.
+ * @param source    Program source.
+ * @param size      Size of the program source (in bytes).
+ * @param fold      Whether to evaluate the beginning of the
+ *                  program in advance.
+ * @param program   Compiled program (set only on success, to be
+ *                  destroyed by the caller).
+ * @param unmatched Position of the first unmatched instruction
+ *                  (set only if there is an unmatched bracket).
+ *
+ * @return ICHIGLYPH_OK if the program was compiled.
+ * @return ICHIGLYPH_UNMATCHED if there is an unmatched bracket.
+ * @return ICHIGLYPH_OUT_OF_MEMORY if the compilation could not
+ *         be performed.
+ *
+ */
+ichiglyph_result_t ichiglyph_program_compile(ichiglyph_language_t language,
+    const void *source, size_t size, bool fold, ichiglyph_program_t **program,
+    size_t *unmatched)
+{
+	language_t *lang = &languages[language];
+	size_t program_size = size / lang->opcode_size;
+	
+	ichiglyph_program_t *compiled =
+	    (ichiglyph_program_t *) malloc(sizeof(ichiglyph_program_t));
+	if (compiled == NULL)
+		return ICHIGLYPH_OUT_OF_MEMORY;
+	
+	size_t position;
+	int ret = program_compile(lang, (const uint8_t *) source, program_size,
+	    &compiled->code, &compiled->code_size, &position);
+	if (ret != 0) {
+		free(compiled);
+		
+		if (position < program_size) {
+			*unmatched = position;
+			return ICHIGLYPH_UNMATCHED;
+		}
+		
+		return ICHIGLYPH_OUT_OF_MEMORY;
+	}
+	
+	/*
+	 * Between two data cell accesses the data pointer can move
+	 * at most by the number of the instructions of the program.
+	 */
+	compiled->reach = program_size;
+	compiled->prefix = NULL;
+	compiled->prefix_size = 0;
+	compiled->prefix_charge = 0;
+	compiled->unfolded = NULL;
+	
+	compiled->language = lang;
+	compiled->folded = false;
+	
+	code_charge(compiled->code, compiled->code_size);
+	
+	if (fold)
+		compiled->folded = (code_fold(&compiled->code, &compiled->code_size,
+		    compiled->reach, &compiled->prefix, &compiled->prefix_size,
+		    &compiled->prefix_charge) == 0);
+	
+	if (compiled->prefix_charge > 0) {
+		ichiglyph_result_t result = ichiglyph_program_compile(language,
+		    source, size, false, &compiled->unfolded, unmatched);
+		if (result != ICHIGLYPH_OK) {
+			free(compiled->prefix);
+			free(compiled->code);
+			free(compiled);
+			return result;
+		}
+	}
+	
+	compiled->lockstep = code_lockstep(compiled->code, compiled->code_size,
+	    &compiled->lockstep_reach, &compiled->lockstep_depth);
+	
+	for (unsigned int i = 0; i < THREAD_VARIANTS; i++)
+		compiled->thread[i] = NULL;
+	compiled->serial =
+	    __atomic_add_fetch(&program_serial, 1, __ATOMIC_RELAXED);
+	
+	*program = compiled;
+	return ICHIGLYPH_OK;
+}
+
+/** Destroy compiled program
+ *
+ * @param program Compiled program.
+ *
+ */
+void ichiglyph_program_destroy(ichiglyph_program_t *program)
+{
+	for (unsigned int i = 0; i < THREAD_VARIANTS; i++)
+		free(program->thread[i]);
+	
+	if (program->unfolded != NULL)
+		ichiglyph_program_destroy(program->unfolded);
+	
+	free(program->prefix);
+	free(program->code);
+	free(program);
+}
+
+/** Check whether a program can be executed in lockstep
+ *
+ * @param program Compiled program.
+ *
+ * @return True if the program can be executed in lockstep.
+ *
+ */
+bool ichiglyph_program_lockstep(const ichiglyph_program_t *program)
+{
+	return program->lockstep;
+}
+
+/** Get the number of the compiled instructions of a program
+ *
+ * @param program Compiled program.
+ *
+ * @return Number of the compiled instructions (including
+ *         the terminating ICHIGLYPH_OP_HALT).
+ *
+ */
+size_t ichiglyph_program_size(const ichiglyph_program_t *program)
+{
+	return program->code_size;
+}
+
+/** Inspect a compiled instruction of a program
+ *
+ * @param program     Compiled program.
+ * @param ip          Index of the compiled instruction (less than
+ *                    the number of the compiled instructions).
+ * @param instruction Compiled instruction.
+ *
+ */
+void ichiglyph_program_instruction(const ichiglyph_program_t *program,
+    size_t ip, ichiglyph_instruction_t *instruction)
+{
+	static const ichiglyph_op_t ops[] = {
+		[CODE_MOVE] = ICHIGLYPH_OP_MOVE,
+		[CODE_ADD] = ICHIGLYPH_OP_ADD,
+		[CODE_SET] = ICHIGLYPH_OP_SET,
+		[CODE_MUL] = ICHIGLYPH_OP_MUL,
+		[CODE_SCAN] = ICHIGLYPH_OP_SCAN,
+		[CODE_OUTPUT] = ICHIGLYPH_OP_OUTPUT,
+		[CODE_ACCEPT] = ICHIGLYPH_OP_ACCEPT,
+		[CODE_CAT] = ICHIGLYPH_OP_CAT,
+		[CODE_JZ] = ICHIGLYPH_OP_JZ,
+		[CODE_JNZ] = ICHIGLYPH_OP_JNZ,
+		[CODE_HALT] = ICHIGLYPH_OP_HALT
+	};
+	
+	const code_t *code = &program->code[ip];
+	
+	instruction->op = ops[code->op];
+	instruction->offset = code->offset;
+	instruction->target = code->target;
+	
+	/*
+	 * The budget charged by the jumps is an implementation
+	 * detail of the engines.
+	 */
+	if ((code->op == CODE_JZ) || (code->op == CODE_JNZ))
+		instruction->arg = 0;
+	else
+		instruction->arg = code->arg;
+}
+
+/** Create virtual machine
+ *
+ * The virtual machine has no input and its output is discarded
+ * until set otherwise.
+ *
+ * @param engine Execution engine.
+ * @param tape   Data memory mode (ICHIGLYPH_TAPE_VIRTUAL installs
+ *               process-wide SIGSEGV and SIGBUS handlers when the
+ *               data memory is first reserved).
+ *
+ * @return Virtual machine or NULL on an out-of-memory condition.
+ *
+ */
+ichiglyph_vm_t *ichiglyph_vm_create(ichiglyph_engine_t engine,
+    ichiglyph_tape_t tape)
+{
+	ichiglyph_vm_t *vm = (ichiglyph_vm_t *) malloc(sizeof(ichiglyph_vm_t));
+	if (vm == NULL)
+		return NULL;
+	
+	data_init(&vm->data);
+	vm->budget = UINT64_MAX;
+	vm->limit = UINT64_MAX;
+	vm->engine = engine;
+	vm->tape = tape;
+	vm->dirty = false;
+	vm->perf = ICHIGLYPH_PERF_NONE;
+	vm->counting = false;
+	memset(&vm->counters, 0, sizeof(vm->counters));
+	
+	vm->write = NULL;
+	vm->write_arg = NULL;
+	vm->output_pos = 0;
+	vm->output_limit = OUTPUT_BUFFER_SIZE;
+	vm->output_line = false;
+	
+	vm->read = NULL;
+	vm->read_arg = NULL;
+	vm->input_memory = NULL;
+	vm->input_memory_size = 0;
+	input_reset(vm);
+	
+#ifdef __x86_64__
+	vm->jit_serial = 0;
+#endif
+	
+	vm->lockstep = NULL;
+	memset(&vm->profile, 0, sizeof(vm->profile));
+	memset(&vm->tier, 0, sizeof(vm->tier));
+	return vm;
+}
+
+/** Destroy virtual machine
+ *
+ * @param vm Virtual machine.
+ *
+ */
+void ichiglyph_vm_destroy(ichiglyph_vm_t *vm)
+{
+	jit_release(vm);
+	tier_release(&vm->tier);
+	profile_release(&vm->profile);
+	data_done(&vm->data);
+	
+	if (vm->lockstep != NULL) {
+		free(vm->lockstep->memory);
+		free(vm->lockstep->stack);
+		free(vm->lockstep);
+	}
+	
+	free(vm);
+}
+
+/** Set the perf output
+ *
+ * The native code generated by the JIT engine is written to the
+ * perf map (/tmp/perf-<pid>.map) and/or the jitdump file
+ * (/tmp/jit-<pid>.dump, to be merged by perf inject --jit), thus
+ * Linux perf can attribute the samples to the loops of the
+ * program. The output is shared by all virtual machines of the
+ * process.
+ *
+ * @param vm   Virtual machine.
+ * @param perf Perf output (combination of ichiglyph_perf_t flags).
+ *
+ */
+void ichiglyph_vm_set_perf(ichiglyph_vm_t *vm, unsigned int perf)
+{
+	vm->perf = perf;
+}
+
+/** Set the counting
+ *
+ * The executions count the dispatched compiled instructions and
+ * the addressed data cells. Unlike the wall-clock time, the
+ * counters are deterministic, thus they can be compared across
+ * the versions of the library to detect performance regressions.
+ * Each engine counts the compiled instructions it executes (the
+ * native code calls back to count them, thus the counting slows
+ * it down considerably). The lockstep executions are not counted.
+ *
+ * @param vm       Virtual machine.
+ * @param counting Whether the executions are counted.
+ *
+ */
+void ichiglyph_vm_set_counting(ichiglyph_vm_t *vm, bool counting)
+{
+	vm->counting = counting;
+}
+
+/** Set the input callback
+ *
+ * The input is read in large blocks using the callback. Each
+ * execution starts with an empty input buffer.
+ *
+ * @param vm   Virtual machine.
+ * @param read Input callback (NULL for no input).
+ * @param arg  Argument of the input callback.
+ *
+ */
+void ichiglyph_vm_set_input(ichiglyph_vm_t *vm, ichiglyph_read_t read,
+    void *arg)
+{
+	vm->read = read;
+	vm->read_arg = arg;
+	vm->input_memory = NULL;
+	vm->input_memory_size = 0;
+}
+
+/** Set the input supplied in the memory
+ *
+ * The input is consumed directly from the memory (without
+ * copying). Each execution starts at the beginning of the
+ * input. The memory must remain valid until the input is set
+ * otherwise.
+ *
+ * @param vm    Virtual machine.
+ * @param input Input bytes.
+ * @param size  Number of the input bytes.
+ *
+ */
+void ichiglyph_vm_set_input_memory(ichiglyph_vm_t *vm, const void *input,
+    size_t size)
+{
+	vm->read = NULL;
+	vm->read_arg = NULL;
+	vm->input_memory = (input != NULL) ?
+	    (const uint8_t *) input : vm->input_buffer;
+	vm->input_memory_size = (input != NULL) ? size : 0;
+}
+
+/** Set the output callback
+ *
+ * The output is always flushed before waiting for the input
+ * and at the end of each execution.
+ *
+ * @param vm     Virtual machine.
+ * @param write  Output callback (NULL to discard the output).
+ * @param arg    Argument of the output callback.
+ * @param buffer Output buffering mode.
+ *
+ */
+void ichiglyph_vm_set_output(ichiglyph_vm_t *vm, ichiglyph_write_t write,
+    void *arg, ichiglyph_buffer_t buffer)
+{
+	vm->write = write;
+	vm->write_arg = arg;
+	vm->output_limit = (buffer == ICHIGLYPH_BUFFER_NONE) ?
+	    1 : OUTPUT_BUFFER_SIZE;
+	vm->output_line = (buffer == ICHIGLYPH_BUFFER_LINE);
+}
+
+/** Execute compiled program
+ *
+ * Execute the compiled program on the virtual machine. Each
+ * execution starts with all data cells set to 0.
+ *
+ * The budget limits the number of the executed compiled
+ * instructions (the budget is charged at each loop boundary,
+ * thus the execution stops at the first loop boundary that
+ * would exceed it). The budget of the beginning of the program
+ * evaluated in advance is charged at once before the execution.
+ * If the budget does not cover it, the program is executed from
+ * the start instead, thus the output (and the number of the
+ * executed instructions) is always the same as without the
+ * evaluation in advance.
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ * @param budget  Budget (0 for no limit).
+ *
+ * @return ICHIGLYPH_OK if the execution terminated normally.
+ * @return ICHIGLYPH_BUDGET if the budget has been exhausted.
+ * @return ICHIGLYPH_OUT_OF_MEMORY if the execution cannot
+ *         continue.
+ *
+ */
+ichiglyph_result_t ichiglyph_vm_run(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, uint64_t budget)
+{
+	if ((budget != 0) && (budget < program->prefix_charge))
+		program = program->unfolded;
+	
+	if (vm->dirty) {
+		data_clear(&vm->data);
+		vm->dirty = false;
+	}
+	
+	/*
+	 * The guard areas need to span the reach of the program.
+	 * If the virtual data memory cannot be reserved, we resize
+	 * the data memory on demand.
+	 */
+	if ((vm->tape == ICHIGLYPH_TAPE_VIRTUAL) &&
+	    (vm->data.guard <= program->reach)) {
+		data_done(&vm->data);
+		(void) data_reserve(&vm->data, program->reach);
+	}
+	
+	vm->budget = (budget != 0) ? budget : UINT64_MAX;
+	vm->limit = vm->budget;
+	input_reset(vm);
+	
+	memset(&vm->counters, 0, sizeof(vm->counters));
+	vm->counters.low = SSIZE_MAX;
+	vm->counters.high = -SSIZE_MAX;
+	
+	if (vm->limit != UINT64_MAX)
+		vm->budget -= program->prefix_charge;
+	
+	if (program->prefix_size > 0)
+		output_write(vm, program->prefix, program->prefix_size);
+	
+	int ret = execute(vm, program);
+	output_flush(vm);
+	vm->dirty = true;
+	
+	if (ret == 0)
+		return ICHIGLYPH_OK;
+	
+	if (ret == ENGINE_BUDGET)
+		return ICHIGLYPH_BUDGET;
+	
+	return ICHIGLYPH_OUT_OF_MEMORY;
+}
+
+/** Get the consumed input
+ *
+ * @param vm Virtual machine.
+ *
+ * @return Number of the bytes of the input supplied in the
+ *         memory consumed by the last execution.
+ *
+ */
+size_t ichiglyph_vm_consumed(ichiglyph_vm_t *vm)
+{
+	if (vm->input_memory == NULL)
+		return 0;
+	
+	return vm->input_pos;
+}
+
+/** Get the executed instructions
+ *
+ * The executed compiled instructions are counted by charging
+ * the budget, thus they are counted only if the execution has
+ * a budget.
+ *
+ * @param vm Virtual machine.
+ *
+ * @return Number of the compiled instructions executed by
+ *         the last execution (0 if it had no budget).
+ *
+ */
+uint64_t ichiglyph_vm_executed(ichiglyph_vm_t *vm)
+{
+	if (vm->limit == UINT64_MAX)
+		return 0;
+	
+	return vm->limit - vm->budget;
+}
+
+/** Get the execution counters
+ *
+ * The calls of the input and output callbacks are always counted,
+ * the dispatched compiled instructions and the addressed data
+ * cells are counted only if the counting has been set (they are
+ * 0 otherwise).
+ *
+ * @param vm       Virtual machine.
+ * @param counters Counters of the last execution.
+ *
+ */
+void ichiglyph_vm_counters(ichiglyph_vm_t *vm, ichiglyph_counters_t *counters)
+{
+	counters->instructions = vm->counters.instructions;
+	counters->span = 0;
+	counters->input = vm->counters.input;
+	counters->output = vm->counters.output;
+	
+	if (vm->counters.high >= vm->counters.low)
+		counters->span = vm->counters.high - vm->counters.low + 1;
+}
+
+/** Write the execution profile
+ *
+ * Write the profile of the last execution of the program on
+ * the virtual machine using the profiling engine. The executions
+ * of the compiled instructions are attributed to the instructions
+ * of the program (the instructions of a loop replaced by an idiom
+ * count as executed once per execution of the idiom).
+ *
+ * The text report lists the loops that execute most instructions
+ * (excluding their nested loops) with their source offsets, trip
+ * count histograms and Brainfuck rendering. The callgrind report
+ * can be examined by KCachegrind.
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ * @param source  Program source (the program was compiled from).
+ * @param size    Size of the program source (in bytes).
+ * @param name    Name of the program source.
+ * @param format  Format of the report.
+ * @param top     Maximal number of the loops in the text report.
+ * @param write   Output callback.
+ * @param arg     Argument of the output callback.
+ *
+ * @return ICHIGLYPH_OK if the report has been written.
+ * @return ICHIGLYPH_UNSUPPORTED if there is no profile of the
+ *         program (or the beginning of the program has been
+ *         evaluated in advance or the source does not match).
+ * @return ICHIGLYPH_OUT_OF_MEMORY if the report could not be
+ *         written.
+ *
+ */
+ichiglyph_result_t ichiglyph_vm_profile(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, const void *source, size_t size,
+    const char *name, ichiglyph_profile_t format, size_t top,
+    ichiglyph_write_t write, void *arg)
+{
+	profile_t *profile = &vm->profile;
+	
+	if ((profile->serial != program->serial) || (program->folded))
+		return ICHIGLYPH_UNSUPPORTED;
+	
+	report_map_t map;
+	int ret = report_map(&map, profile, program, (const uint8_t *) source,
+	    size);
+	if (ret > 0)
+		return ICHIGLYPH_UNSUPPORTED;
+	
+	if (ret < 0)
+		return ICHIGLYPH_OUT_OF_MEMORY;
+	
+	report_t report;
+	report.write = write;
+	report.arg = arg;
+	
+	if (format == ICHIGLYPH_PROFILE_CALLGRIND)
+		ret = report_callgrind(&report, &map, profile, program,
+		    (const uint8_t *) source, name);
+	else
+		ret = report_text(&report, &map, profile, program,
+		    (const uint8_t *) source, name, top);
+	
+	report_unmap(&map);
+	return (ret == 0) ? ICHIGLYPH_OK : ICHIGLYPH_OUT_OF_MEMORY;
+}
+
+/** Execute compiled program in lockstep
+ *
+ * Execute the compiled program on multiple inputs at once.
+ * Each execution starts with all data cells set to 0 and
+ * its input is supplied in the memory. The output of each
+ * lane is fully buffered. The budget applies to each lane
+ * separately (including the beginning of the program evaluated
+ * in advance, which is executed from the start instead if the
+ * budget does not cover it, as in ichiglyph_vm_run()).
+ *
+ * @param vm      Virtual machine.
+ * @param program Compiled program.
+ * @param lanes   Lanes (the results are set only on success).
+ * @param count   Number of the lanes (at most ICHIGLYPH_LANES).
+ * @param budget  Budget (0 for no limit).
+ *
+ * @return ICHIGLYPH_OK if the lanes have been executed.
+ * @return ICHIGLYPH_UNSUPPORTED if the program cannot be
+ *         executed in lockstep.
+ * @return ICHIGLYPH_OUT_OF_MEMORY if the execution cannot
+ *         continue.
+ *
+ */
+ichiglyph_result_t ichiglyph_vm_run_lockstep(ichiglyph_vm_t *vm,
+    const ichiglyph_program_t *program, ichiglyph_lane_t *lanes, size_t count,
+    uint64_t budget)
+{
+	if ((budget != 0) && (budget < program->prefix_charge))
+		program = program->unfolded;
+	
+	if ((!program->lockstep) || (count > ICHIGLYPH_LANES))
+		return ICHIGLYPH_UNSUPPORTED;
+	
+	lockstep_t *lockstep = vm->lockstep;
+	if (lockstep == NULL) {
+		lockstep = (lockstep_t *) calloc(1, sizeof(lockstep_t));
+		if (lockstep == NULL)
+			return ICHIGLYPH_OUT_OF_MEMORY;
+		
+		vm->lockstep = lockstep;
+	}
+	
+	if (lockstep->depth < program->lockstep_depth) {
+		lanes_t *stack = (lanes_t *) realloc(lockstep->stack,
+		    program->lockstep_depth * sizeof(lanes_t));
+		if (stack == NULL)
+			return ICHIGLYPH_OUT_OF_MEMORY;
+		
+		lockstep->stack = stack;
+		lockstep->depth = program->lockstep_depth;
+	}
+	
+	if (lockstep->memory != NULL)
+		memset(lockstep->memory, 0, lockstep->size * sizeof(lanes_t));
+	
+	lanes_t live = { 0 };
+	
+	for (size_t i = 0; i < count; i++) {
+		lane_t *lane = &lockstep->lanes[i];
+		
+		lane->input = (const uint8_t *) lanes[i].input;
+		lane->input_size = lanes[i].input_size;
+		lane->input_pos = 0;
+		lane->write = lanes[i].write;
+		lane->write_arg = lanes[i].write_arg;
+		lane->output_pos = 0;
+		lane->budget = (budget != 0) ? budget : UINT64_MAX;
+		lane->result = ICHIGLYPH_OK;
+		
+		if (budget != 0)
+			lane->budget -= program->prefix_charge;
+		
+		if (program->prefix_size > 0)
+			lane_write(lane, program->prefix, program->prefix_size);
+		
+		live[i] = 0xff;
+	}
+	
+	int ret = execute_lockstep(lockstep, program, live, budget != 0);
+	
+	for (size_t i = 0; i < count; i++) {
+		lane_flush(&lockstep->lanes[i]);
+		lanes[i].result = lockstep->lanes[i].result;
+		lanes[i].executed = (budget != 0) ?
+		    budget - lockstep->lanes[i].budget : 0;
+	}
+	
+	return (ret == 0) ? ICHIGLYPH_OK : ICHIGLYPH_OUT_OF_MEMORY;
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2017 Martin Decky
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * - Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright
+ *   notice, this list of conditions and the following disclaimer in the
+ *   documentation and/or other materials provided with the distribution.
+ * - The name of the author may not be used to endorse or promote products
+ *   derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** @file
+ *
+ * This is Ichiglyph (or Brainfuck) to C transpiler. It compiles
+ * the Ichiglyph (or Brainfuck) instructions by the Ichiglyph library
+ * in the same way as the interpreters do (folding runs of identical
+ * instructions and replacing the common loop idioms) and outputs
+ * a standalone C program that executes the compiled instructions
+ * in straight-line code. The C program can be further optimized by
+ * the system C compiler, eliminating the interpreter overhead
+ * entirely.
+ *
+ * The data memory of the C program has a fixed size (TAPE_SIZE
+ * bytes, which can be overridden when compiling the C program),
+ * since it is allocated statically. The data memory pointer starts
+ * in the middle of the data memory (thus the program can move both
+ * left and right of the origin) and it is not checked against the
+ * bounds of the data memory.
+ *
+ * Note that any characters not representing an instruction are
+ * silently ignored and dropped.
+ *
+ * The Ichiglyph language was inspired by a remark by Josefina Madrova,
+ * who cleverly noted that using the characters l, I and 1 in identifiers
+ * is a bad practice.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ichiglyph.h>
+
+/** Source language */
+typedef struct {
+	const char *name;               /**< Name of the language */
+	ichiglyph_language_t language;  /**< Language of the library */
+} language_t;
+
+/** Source languages (the first one is the default) */
+static language_t languages[] = {
+	{
+		.name = "ichiglyph",
+		.language = ICHIGLYPH_LANGUAGE_ICHIGLYPH
+	},
+	{
+		.name = "brainfuck",
+		.language = ICHIGLYPH_LANGUAGE_BRAINFUCK
+	}
+};
+
+/** Indent the generated C code
+ *
+ * @param depth Nesting depth of the generated C code.
+ *
+ */
+static void indent(size_t depth)
+{
+	for (size_t i = 0; i < depth; i++)
+		fputc('\t', stdout);
+}
+
+/** Translate compiled code to C
+ *
+ * Output a standalone C program that executes the compiled
+ * code. The loops are translated into while statements and
+ * all other compiled instructions into straight-line code.
+ *
+ * @param source_name Name of the source file.
+ * @param program     Compiled program.
+ *
+ */
+static void code_translate(const char *source_name,
+    const ichiglyph_program_t *program)
+{
+	size_t code_size = ichiglyph_program_size(program);
+	ichiglyph_instruction_t code;
+	
+	bool input = false;
+	for (size_t ip = 0; ip < code_size; ip++) {
+		ichiglyph_program_instruction(program, ip, &code);
+		if ((code.op == ICHIGLYPH_OP_ACCEPT) || (code.op == ICHIGLYPH_OP_CAT))
+			input = true;
+	}
+	
+	printf("/* Generated by ig2c from %s */\n\n", source_name);
+	printf("#include <stdio.h>\n");
+	printf("#include <stdint.h>\n\n");
+	printf("#ifndef TAPE_SIZE\n");
+	printf("\t#define TAPE_SIZE  (64 << 20)\n");
+	printf("#endif\n\n");
+	printf("static uint8_t tape[TAPE_SIZE];\n\n");
+	printf("int main(void)\n");
+	printf("{\n");
+	printf("\tuint8_t *p = tape + TAPE_SIZE / 2;\n");
+	
+	if (input)
+		printf("\tint c;\n");
+	
+	printf("\t\n");
+	
+	size_t depth = 1;
+	
+	for (size_t ip = 0; ip < code_size; ip++) {
+		ichiglyph_program_instruction(program, ip, &code);
+		
+		if (code.op == ICHIGLYPH_OP_JNZ)
+			depth--;
+		
+		indent(depth);
+		
+		switch (code.op) {
+		case ICHIGLYPH_OP_MOVE:
+			printf("p += %zd;\n", code.arg);
+			break;
+		case ICHIGLYPH_OP_ADD:
+			printf("p[%zd] += %zd;\n", code.offset, code.arg);
+			break;
+		case ICHIGLYPH_OP_SET:
+			printf("p[%zd] = %zd;\n", code.offset, code.arg);
+			break;
+		case ICHIGLYPH_OP_MUL:
+			printf("p[%zd] += *p * %zd;\n", code.offset, code.arg);
+			break;
+		case ICHIGLYPH_OP_SCAN:
+			printf("while (*p != 0)\n");
+			indent(depth + 1);
+			printf("p += %zd;\n", code.arg);
+			break;
+		case ICHIGLYPH_OP_OUTPUT:
+			printf("putchar(p[%zd]);\n", code.offset);
+			break;
+		case ICHIGLYPH_OP_ACCEPT:
+			/*
+			 * Flush the output before waiting for the input
+			 * (for the sake of interactive programs).
+			 */
+			printf("fflush(stdout);\n");
+			indent(depth);
+			printf("c = getchar();\n");
+			indent(depth);
+			printf("if (c == EOF)\n");
+			indent(depth + 1);
+			printf("goto end;\n");
+			indent(depth);
+			printf("p[%zd] = c;\n", code.offset);
+			break;
+		case ICHIGLYPH_OP_CAT:
+			/*
+			 * The copy idiom is translated back into a loop.
+			 */
+			printf("while (*p != 0) {\n");
+			
+			if (code.arg != 0) {
+				indent(depth + 1);
+				printf("putchar(*p);\n");
+			}
+			
+			indent(depth + 1);
+			printf("fflush(stdout);\n");
+			indent(depth + 1);
+			printf("c = getchar();\n");
+			indent(depth + 1);
+			printf("if (c == EOF)\n");
+			indent(depth + 2);
+			printf("goto end;\n");
+			indent(depth + 1);
+			printf("*p = c;\n");
+			
+			if (code.arg == 0) {
+				indent(depth + 1);
+				printf("putchar(*p);\n");
+			}
+			
+			indent(depth);
+			printf("}\n");
+			break;
+		case ICHIGLYPH_OP_JZ:
+			printf("while (*p != 0) {\n");
+			depth++;
+			break;
+		case ICHIGLYPH_OP_JNZ:
+			printf("}\n");
+			break;
+		case ICHIGLYPH_OP_HALT:
+			printf("\n");
+			break;
+		}
+	}
+	
+	if (input)
+		printf("end:\n");
+	
+	printf("\treturn 0;\n");
+	printf("}\n");
+}
+
+/** Print usage
+ *
+ * @param name Name of the executable.
+ *
+ */
+static void usage(const char *name)
+{
+	fprintf(stderr, "Syntax: %s [<options>] <source>\n", name);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  --brainfuck  The source is a Brainfuck program\n");
+	fprintf(stderr, "  --ichiglyph  The source is an Ichiglyph program (default)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	/*
+	 * The command-line options are followed by the source file.
+	 */
+	language_t *language = &languages[0];
+	int arg = 1;
+	
+	while ((arg < argc) && (strncmp(argv[arg], "--", 2) == 0)) {
+		size_t i;
+		for (i = 0; i < sizeof(languages) / sizeof(languages[0]); i++) {
+			if (strcmp(argv[arg] + 2, languages[i].name) == 0)
+				break;
+		}
+		
+		if (i == sizeof(languages) / sizeof(languages[0])) {
+			fprintf(stderr, "%s: Unknown option\n", argv[arg]);
+			usage(argv[0]);
+			return 1;
+		}
+		
+		language = &languages[i];
+		arg++;
+	}
+	
+	if (arg >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	
+	char *source_name = argv[arg];
+	int source = open(source_name, O_RDONLY);
+	if (source < 0) {
+		fprintf(stderr, "%s: Unable to open\n", source_name);
+		return 2;
+	}
+	
+	struct stat stat;
+	int ret = fstat(source, &stat);
+	if (ret != 0) {
+		fprintf(stderr, "%s: Unable to stat\n", source_name);
+		close(source);
+		return 3;
+	}
+	
+	size_t source_size = stat.st_size;
+	
+	/*
+	 * We mmap the entire source file.
+	 */
+	void *program = mmap(NULL, source_size, PROT_READ, MAP_PRIVATE,
+	    source, 0);
+	if (program == MAP_FAILED) {
+		fprintf(stderr, "%s: Unable to mmap\n", source_name);
+		close(source);
+		return 4;
+	}
+	
+	/*
+	 * The beginning of the program is not evaluated in advance,
+	 * since the C program is supposed to compute everything.
+	 */
+	ichiglyph_program_t *compiled;
+	size_t unmatched;
+	ichiglyph_result_t result = ichiglyph_program_compile(
+	    language->language, program, source_size, false, &compiled,
+	    &unmatched);
+	
+	munmap(program, source_size);
+	close(source);
+	
+	if (result != ICHIGLYPH_OK) {
+		if (result == ICHIGLYPH_UNMATCHED)
+			fprintf(stderr, "%s: Unmatched bracket at instruction %zu\n",
+			    source_name, unmatched);
+		else
+			fprintf(stderr, "%s: Out of memory\n", source_name);
+		
+		return 5;
+	}
+	
+	code_translate(source_name, compiled);
+	ichiglyph_program_destroy(compiled);
+	
+	return 0;
+}